@@ -0,0 +1,86 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+
+// Allocate a fresh chunk able to hold at least `size` bytes
+static ArenaChunk* create_ArenaChunk(size_t size) {
+	ArenaChunk* c = malloc(sizeof(ArenaChunk) + size);
+	if (!c) { perror("malloc"); exit(1); }
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	return c;
+}
+
+// Create an empty arena; chunk_size == 0 selects the default chunk size
+Arena* create_Arena(size_t chunk_size) {
+	Arena* a = malloc(sizeof(Arena));
+	if (!a) { perror("malloc"); exit(1); }
+
+	a->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+	a->first = create_ArenaChunk(a->chunk_size);
+	a->current = a->first;
+	a->allocated = 0;
+	a->generation = 0;
+	return a;
+}
+
+// Bump-allocate `size` bytes (aligned for any type). Never returns NULL.
+void* arena_alloc(Arena* a, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	ArenaChunk* c = a->current;
+
+	if (c->used + size > c->size) {
+		// Reuse the next chunk kept from a previous reset if it is big enough,
+		// otherwise splice a new one in after the current chunk.
+		ArenaChunk* next = c->next;
+		if (next && size <= next->size) {
+			next->used = 0;
+		} else {
+			next = create_ArenaChunk(size > a->chunk_size ? size : a->chunk_size);
+			next->next = c->next;
+			c->next = next;
+		}
+		a->current = c = next;
+	}
+
+	void* res = c->data + c->used;
+	c->used += size;
+	a->allocated += size;
+	return res;
+}
+
+// Copy a NUL-terminated string into the arena
+char* arena_strdup(Arena* a, const char* s) {
+	if (!s) return NULL;
+	size_t len = strlen(s) + 1;
+	char* res = arena_alloc(a, len);
+	memcpy(res, s, len);
+	return res;
+}
+
+// Release everything allocated so far in O(1); chunks are kept for reuse
+void arena_reset(Arena* a) {
+	a->current = a->first;
+	a->first->used = 0;
+	a->allocated = 0;
+	a->generation++;
+}
+
+// Free the arena and all its chunks
+void free_Arena(Arena* a) {
+	if (!a) return;
+
+	ArenaChunk* c = a->first;
+	while (c) {
+		ArenaChunk* next = c->next;
+		free(c);
+		c = next;
+	}
+	free(a);
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdalign.h>
+#include <stddef.h>
+
+// One contiguous block of memory handed out by bump allocation. data is
+// aligned like malloc's result, so every bump offset (a multiple of
+// alignof(max_align_t)) stays aligned for any type.
+typedef struct ArenaChunk_ {
+	struct ArenaChunk_* next;
+	size_t size;
+	size_t used;
+	alignas(max_align_t) char data[];
+} ArenaChunk;
+
+// Region allocator: everything allocated from it is released at once by
+// arena_reset() (chunks are kept for reuse) or free_Arena().
+typedef struct Arena_ {
+	ArenaChunk* first;
+	ArenaChunk* current;
+	size_t chunk_size;
+	size_t allocated; // bytes handed out since the last reset
+	unsigned long generation; // bumped by every reset (lets caches detect stale entries)
+} Arena;
+
+
+Arena* create_Arena(size_t chunk_size);
+void* arena_alloc(Arena* a, size_t size);
+char* arena_strdup(Arena* a, const char* s);
+void arena_reset(Arena* a);
+void free_Arena(Arena* a);
+
+#endif
@@ -1,56 +1,375 @@
 #include "ast.h"
+#include "hashmap.h"
+#include "stats.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Arena owning every node, statement array and string built by this module.
+// The caller that owns a verification job releases it in one go.
+// Per thread, so independent programs can be built concurrently.
+static _Thread_local Arena* ast_arena = NULL;
+
+// Select the arena used by all subsequent AST allocations of this thread
+void ast_set_arena(Arena* a) {
+	ast_arena = a;
+}
+
+Arena* ast_get_arena(void) {
+	return ast_arena;
+}
+
+// Allocate AST memory from the current arena
+void* ast_alloc(size_t size) {
+	if (!ast_arena) {
+		fprintf(stderr, "ast_alloc: no arena set (call ast_set_arena first)\n");
+		exit(1);
+	}
+	return arena_alloc(ast_arena, size);
+}
+
+// Copy a string into the current arena
+char* ast_strdup(const char* s) {
+	if (!s) return NULL;
+	size_t len = strlen(s) + 1;
+	char* res = ast_alloc(len);
+	memcpy(res, s, len);
+	return res;
+}
+
+// Number of nodes allocated by alloc_node on this thread (statistics)
+static _Thread_local unsigned long nodes_allocated = 0;
+
+unsigned long ast_nodes_allocated(void) {
+	return nodes_allocated;
+}
+
 // Allocate and initialize a new ASTNode of the given type
 ASTNode* alloc_node(NodeType type) {
-	ASTNode* node = malloc(sizeof(ASTNode));
-	if (!node) return NULL;
+	ASTNode* node = ast_alloc(sizeof(ASTNode));
 	memset(node, 0, sizeof(ASTNode)); // ensure all fields are zeroed
 	node->type = type;
-	node->freed = 0;
+	nodes_allocated++;
+	stats_count(COUNTER_NODES_ALLOCATED, 1);
 	return node;
 }
 
-// Create a binary operation node (e.g., +, -, *, /)
-ASTNode* create_node_binary(char* type, ASTNode* left, ASTNode* right) {
-	ASTNode* res = alloc_node(NODE_BIN_OP);
+// ==================== Explicit stacks ====================
+
+/* Expressions built from long chains (a + b + c + ..., conjunctions of
+   many obligations) are as deep as they are long, so traversals keep
+   their pending nodes on a heap-allocated WorkStack rather than on the
+   native stack. */
+
+void work_init(WorkStack* s, size_t item_size) {
+	s->item_size = item_size;
+	s->count = 0;
+	s->capacity = 64;
+	s->items = malloc(s->capacity * item_size);
+	if (!s->items) { perror("malloc"); exit(1); }
+}
+
+// Room for one more frame on top (filled in by the caller)
+void* work_push(WorkStack* s) {
+	if (s->count == s->capacity) {
+		s->capacity *= 2;
+		s->items = realloc(s->items, s->capacity * s->item_size);
+		if (!s->items) { perror("realloc"); exit(1); }
+	}
+	return s->items + s->item_size * s->count++;
+}
+
+// Top frame, removed from the stack (valid until the next push); NULL when empty
+void* work_pop(WorkStack* s) {
+	if (s->count == 0) return NULL;
+	return s->items + s->item_size * --s->count;
+}
+
+void work_free(WorkStack* s) {
+	free(s->items);
+	s->items = NULL;
+	s->count = s->capacity = 0;
+}
 
-	res->binary_op.op = strdup(type);
-	res->binary_op.left = left;
-	res->binary_op.right = right;
+// Number of expression children of a node (blocks of if/while are not
+// included). Their slots, in source order, are child_slot(node, 0 .. n-1).
+int child_count(const ASTNode* node) {
+	switch (node->type) {
+		case NODE_ASSIGN:
+		case NODE_IF_ELSE:
+		case NODE_UNARY_OP:
+		case NODE_LABEL:
+			return 1;
+		case NODE_FUNCTION:
+		case NODE_BIN_OP:
+			return 2;
+		case NODE_WHILE:
+		case NODE_ITE:
+			return 3;
+		case NODE_NARY:
+			return node->nary.count;
+		default:
+			return 0;
+	}
+}
+
+// Address of the i-th child; it may hold NULL (e.g. fact's arg2)
+ASTNode** child_slot(ASTNode* node, int i) {
+	switch (node->type) {
+		case NODE_ASSIGN:	return &node->Assign.expr;
+		case NODE_IF_ELSE:	return &node->If.condition;
+		case NODE_UNARY_OP:	return &node->unary_op.child;
+		case NODE_LABEL:	return &node->label.child;
+		case NODE_FUNCTION:	return i == 0 ? &node->function.arg1 : &node->function.arg2;
+		case NODE_BIN_OP:	return i == 0 ? &node->binary_op.left : &node->binary_op.right;
+		case NODE_NARY:		return &node->nary.args[i];
+		case NODE_WHILE:
+			return i == 0 ? &node->While.condition : i == 1 ? &node->While.invariant : &node->While.variant;
+		case NODE_ITE:
+			return i == 0 ? &node->ite.condition : i == 1 ? &node->ite.then_term : &node->ite.else_term;
+		default:
+			return NULL;
+	}
+}
+
+// Child of a node that is only read
+static const ASTNode* child_at(const ASTNode* node, int i) {
+	return *child_slot((ASTNode*)node, i);
+}
+
+// ==================== Hash-consing of expression nodes ====================
+
+/* When sharing is enabled, structurally equal expression nodes (numbers,
+   booleans, identifiers, operators, function calls) are built only once:
+   every create_node_* call first looks the node up in this table. Nodes are
+   immutable and live as long as the arena, so clone_node() can return its
+   argument and the VC becomes a DAG instead of a tree. The table itself is
+   allocated in the arena and is dropped whenever the arena is reset.
+   The switch is process-wide; the table belongs to the thread's arena. */
+static int sharing_enabled = 0;
+
+static _Thread_local ASTNode** share_slots = NULL;
+static _Thread_local size_t share_capacity = 0;
+static _Thread_local size_t share_count = 0;
+static _Thread_local Arena* share_arena = NULL;
+static _Thread_local unsigned long share_generation = 0;
+
+void ast_set_sharing(int enabled) {
+	sharing_enabled = enabled;
+}
+
+int ast_sharing(void) {
+	return sharing_enabled;
+}
+
+static size_t mix_hash(size_t h, size_t v) {
+	h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+	return h;
+}
+
+// Hash over the node's own fields; children are hashed by identity
+// because they are already shared.
+static size_t node_hash(const ASTNode* n) {
+	size_t h = (size_t)n->type;
+
+	switch (n->type) {
+		case NODE_NUMBER:	return mix_hash(h, (size_t)n->number);
+		case NODE_BOOL:		return mix_hash(h, (size_t)n->bool_value);
+
+		case NODE_ID:		return mix_hash(h, (size_t)n->id_sym);
+
+		case NODE_BIN_OP:
+			h = mix_hash(h, n->binary_op.op);
+			h = mix_hash(h, (size_t)n->binary_op.left);
+			return mix_hash(h, (size_t)n->binary_op.right);
+
+		case NODE_UNARY_OP:
+			h = mix_hash(h, n->unary_op.op);
+			return mix_hash(h, (size_t)n->unary_op.child);
+
+		case NODE_FUNCTION:
+			h = mix_hash(h, n->function.func);
+			h = mix_hash(h, (size_t)n->function.arg1);
+			return mix_hash(h, (size_t)n->function.arg2);
+
+		case NODE_LABEL: {
+			const unsigned char* c = (const unsigned char*)n->label.text;
+			while (*c) h = h * 33 + *c++;
+			return mix_hash(h, (size_t)n->label.child);
+		}
+
+		case NODE_ITE:
+			h = mix_hash(h, (size_t)n->ite.condition);
+			h = mix_hash(h, (size_t)n->ite.then_term);
+			return mix_hash(h, (size_t)n->ite.else_term);
+
+		case NODE_NARY:
+			h = mix_hash(h, n->nary.op);
+			for (int i = 0; i < n->nary.count; i++) h = mix_hash(h, (size_t)n->nary.args[i]);
+			return h;
+
+		default:
+			return h;
+	}
+}
+
+// Shallow structural equality (children compared by identity)
+static int node_shallow_equal(const ASTNode* a, const ASTNode* b) {
+	if (a->type != b->type) return 0;
+
+	switch (a->type) {
+		case NODE_NUMBER:	return a->number == b->number;
+		case NODE_BOOL:		return a->bool_value == b->bool_value;
+		case NODE_ID:		return a->id_sym == b->id_sym;
+
+		case NODE_BIN_OP:
+			return a->binary_op.op == b->binary_op.op
+				&& a->binary_op.left == b->binary_op.left
+				&& a->binary_op.right == b->binary_op.right;
+
+		case NODE_UNARY_OP:
+			return a->unary_op.op == b->unary_op.op
+				&& a->unary_op.child == b->unary_op.child;
+
+		case NODE_FUNCTION:
+			return a->function.func == b->function.func
+				&& a->function.arg1 == b->function.arg1
+				&& a->function.arg2 == b->function.arg2;
+
+		case NODE_LABEL:
+			return a->label.child == b->label.child
+				&& strcmp(a->label.text, b->label.text) == 0;
+
+		case NODE_ITE:
+			return a->ite.condition == b->ite.condition
+				&& a->ite.then_term == b->ite.then_term
+				&& a->ite.else_term == b->ite.else_term;
+
+		case NODE_NARY:
+			return a->nary.op == b->nary.op
+				&& a->nary.count == b->nary.count
+				&& memcmp(a->nary.args, b->nary.args, a->nary.count * sizeof(ASTNode*)) == 0;
+
+		default:
+			return 0;
+	}
+}
+
+// Give a copied n-ary node its own operand array in the arena
+static void copy_operands(ASTNode* node) {
+	if (node->type != NODE_NARY) return;
+	ASTNode** args = ast_alloc(node->nary.count * sizeof(ASTNode*));
+	memcpy(args, node->nary.args, node->nary.count * sizeof(ASTNode*));
+	node->nary.args = args;
+}
+
+// Copy a prototype node into the arena (label texts and operand arrays are
+// copied too; identifier names are interned and outlive the arena)
+static ASTNode* copy_node(const ASTNode* proto) {
+	ASTNode* res = alloc_node(proto->type);
+	*res = *proto;
+	if (proto->type == NODE_LABEL) res->label.text = ast_strdup(proto->label.text);
+	copy_operands(res);
 	return res;
 }
 
-// Create a unary operation node (e.g., -x, not x)
-ASTNode* create_node_unary(char* type, ASTNode* child) {
-	ASTNode* res = alloc_node(NODE_UNARY_OP);
+// Insert into the share table without checking for duplicates
+static void share_insert(ASTNode* node) {
+	size_t mask = share_capacity - 1;
+	size_t i = node_hash(node) & mask;
+	while (share_slots[i]) i = (i + 1) & mask;
+	share_slots[i] = node;
+	share_count++;
+}
+
+// (Re)allocate the share table in the arena, rehashing live entries
+static void share_resize(size_t capacity) {
+	ASTNode** old = share_slots;
+	size_t old_capacity = share_capacity;
 
-	res->unary_op.op = strdup(type);
-	res->unary_op.child = child;
+	share_slots = ast_alloc(capacity * sizeof(ASTNode*));
+	memset(share_slots, 0, capacity * sizeof(ASTNode*));
+	share_capacity = capacity;
+	share_count = 0;
 
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old[i]) share_insert(old[i]);
+	}
+}
+
+// Return the unique node equal to proto, creating it on first use
+static ASTNode* share_node(const ASTNode* proto) {
+	if (!sharing_enabled) return copy_node(proto);
+
+	// The table lives in the arena: start over after a reset or arena switch
+	if (share_arena != ast_arena || !ast_arena || share_generation != ast_arena->generation) {
+		share_slots = NULL;
+		share_capacity = 0;
+		share_count = 0;
+		share_arena = ast_arena;
+		share_generation = ast_arena ? ast_arena->generation : 0;
+		share_resize(1024);
+	}
+
+	size_t mask = share_capacity - 1;
+	size_t i = node_hash(proto) & mask;
+	while (share_slots[i]) {
+		if (node_shallow_equal(share_slots[i], proto)) return share_slots[i];
+		i = (i + 1) & mask;
+	}
+
+	ASTNode* res = copy_node(proto);
+	if ((share_count + 1) * 2 > share_capacity) share_resize(share_capacity * 2);
+	share_insert(res);
 	return res;
 }
 
+// Create a binary operation node (e.g., +, -, *, /)
+ASTNode* create_node_binary(OpCode op, ASTNode* left, ASTNode* right) {
+	ASTNode res = { .type = NODE_BIN_OP };
+
+	res.binary_op.op = op;
+	res.binary_op.left = left;
+	res.binary_op.right = right;
+	return share_node(&res);
+}
+
+// Create a unary operation node (e.g., -x, not x)
+ASTNode* create_node_unary(OpCode op, ASTNode* child) {
+	ASTNode res = { .type = NODE_UNARY_OP };
+
+	res.unary_op.op = op;
+	res.unary_op.child = child;
+
+	return share_node(&res);
+}
+
 // Create a numeric literal node
 ASTNode* create_node_number(int num) {
-	ASTNode* res = alloc_node(NODE_NUMBER);
-	res->number = num;
-	return res;
+	ASTNode res = { .type = NODE_NUMBER };
+	res.number = num;
+	return share_node(&res);
 }
 
-// Create an identifier node (variable reference)
-ASTNode* create_node_id(char *input) {
-	ASTNode* res = alloc_node(NODE_ID);
+// Create an identifier node (variable reference) for an interned symbol
+ASTNode* create_node_symbol(int sym) {
+	ASTNode res = { .type = NODE_ID };
 
-	res->id_name = strdup(input);
-	return res;
+	res.id_name = (char*)symbol_name(sym);
+	res.id_sym = sym;
+	return share_node(&res);
 }
 
-// Create an assignment node (id = expr)
-ASTNode* create_node_assign(char* id, ASTNode* expr){
+// Create an identifier node from its name
+ASTNode* create_node_id(const char* name) {
+	return create_node_symbol(intern_symbol(name));
+}
+
+// Create an assignment node (sym = expr)
+ASTNode* create_node_assign(int sym, ASTNode* expr){
 	ASTNode* res = alloc_node(NODE_ASSIGN);
-	res->Assign.id = strdup(id);
+	res->Assign.id = (char*)symbol_name(sym);
+	res->Assign.sym = sym;
 	res->Assign.expr = expr;
 	return res;
 }
@@ -77,61 +396,206 @@ ASTNode* create_node_While(ASTNode* condition, DLL* block, ASTNode* invariant, A
 }
 
 // Create a function call node (supports up to 2 arguments)
-ASTNode* create_node_Func(const char* name, ASTNode* a1, ASTNode* a2) {
-	ASTNode* res = alloc_node(NODE_FUNCTION);
+ASTNode* create_node_Func(FuncCode func, ASTNode* a1, ASTNode* a2) {
+	ASTNode res = { .type = NODE_FUNCTION };
 
-	res->function.fname = strdup(name);
-	res->function.arg1 = a1;
-	res->function.arg2 = a2;
-	return res;
+	res.function.func = func;
+	res.function.arg1 = a1;
+	res.function.arg2 = a2;
+	return share_node(&res);
 }
 
 // Create a boolean literal node
 ASTNode* create_node_bool(int value) {
-	ASTNode* res = alloc_node(NODE_BOOL);
+	ASTNode res = { .type = NODE_BOOL };
 
-	res->bool_value = value;
-	return res;
+	res.bool_value = value;
+	return share_node(&res);
+}
+
+// Create a label naming the origin of a VC part (text is copied)
+ASTNode* create_node_label(const char* text, ASTNode* child) {
+	ASTNode res = { .type = NODE_LABEL };
+
+	res.label.text = text;
+	res.label.child = child;
+	return share_node(&res);
 }
 
-// ==================== Doubly-linked list of AST nodes ====================
+// Create a conditional term ite(condition, then_term, else_term)
+ASTNode* create_node_ite(ASTNode* condition, ASTNode* then_term, ASTNode* else_term) {
+	ASTNode res = { .type = NODE_ITE };
 
-// Allocate a new DLL (list of statements with optional pre/post conditions)
+	res.ite.condition = condition;
+	res.ite.then_term = then_term;
+	res.ite.else_term = else_term;
+	return share_node(&res);
+}
+
+int is_associative_op(OpCode op) {
+	return op == OP_AND || op == OP_OR || op == OP_ADD || op == OP_MUL;
+}
+
+// Value of an empty chain of an associative operator
+static ASTNode* nary_unit(OpCode op) {
+	switch (op) {
+		case OP_AND:	return create_node_bool(1);
+		case OP_OR:		return create_node_bool(0);
+		case OP_MUL:	return create_node_number(1);
+		default:		return create_node_number(0);
+	}
+}
+
+// One n-ary node over args[0 .. count-1], taken as they are (at least two)
+static ASTNode* nary_node(OpCode op, ASTNode** args, int count) {
+	ASTNode res = { .type = NODE_NARY };
+	res.nary.op = op;
+	res.nary.count = count;
+	res.nary.args = args;
+	return share_node(&res); // copies the array into the arena
+}
+
+// Create args[0] op ... op args[count-1] for an associative operator, as
+// one node over a contiguous array (`args` itself is copied). Operands that
+// are n-ary nodes of the same operator are spliced in, so chains stay flat;
+// a single operand is returned as is.
+ASTNode* create_node_nary(OpCode op, ASTNode** args, int count) {
+	int total = 0;
+	for (int i = 0; i < count; i++) {
+		total += (args[i]->type == NODE_NARY && args[i]->nary.op == op) ? args[i]->nary.count : 1;
+	}
+	if (total == 0) return nary_unit(op);
+	if (total == 1) return args[0];
+
+	ASTNode** flat = malloc(total * sizeof(ASTNode*));
+	if (!flat) { perror("malloc"); exit(1); }
+	int n = 0;
+	for (int i = 0; i < count; i++) {
+		if (args[i]->type == NODE_NARY && args[i]->nary.op == op) {
+			memcpy(flat + n, args[i]->nary.args, args[i]->nary.count * sizeof(ASTNode*));
+			n += args[i]->nary.count;
+		} else {
+			flat[n++] = args[i];
+		}
+	}
+
+	ASTNode* node = nary_node(op, flat, total);
+	free(flat);
+	return node;
+}
+
+// ==================== Statement blocks ====================
+
+// Allocate a new, empty block (list of statements with optional pre/post conditions)
 DLL* create_DLL() {
-	DLL* res = malloc(sizeof(DLL));
-	res->first = NULL;
-	res->last = NULL;
+	DLL* res = ast_alloc(sizeof(DLL));
+	res->stmts = NULL;
+	res->count = 0;
+	res->capacity = 0;
 	res->pre = NULL;
 	res->post = NULL;
 	return res;
 }
 
-// Create a new linked list element containing one AST node
-line_linkedlist* create_ll(ASTNode* node) {
-	line_linkedlist* list = malloc(sizeof(line_linkedlist));
-	list->next = NULL;
-	list->prec = NULL;
-	list->node=node;
-	return list;
-}
-
-// Append an AST node to the DLL
+// Append a statement to the block (the array doubles in the arena when full)
 void DLL_append(DLL* list, ASTNode* node) {
-	line_linkedlist* l = create_ll(node);
+	if (list->count == list->capacity) {
+		int capacity = list->capacity ? 2 * list->capacity : 4;
+		ASTNode** stmts = ast_alloc(capacity * sizeof(ASTNode*));
+		if (list->count) memcpy(stmts, list->stmts, list->count * sizeof(ASTNode*));
+		list->stmts = stmts;
+		list->capacity = capacity;
+	}
+	list->stmts[list->count++] = node;
+}
 
-	if(list->last == NULL) {  // list is empty
-		list->first = l;
-		list->last = l;
-	} 
-	else {
-		list->last->next = l;
-		l->prec = list->last;
-		list->last = l;
+// Add to `out` the symbols assigned in code, at any depth, not yet in `seen`
+static void collect_assigned(const DLL* code, SubstEnv* seen, int** out, int* count, int* cap) {
+	if (!code) return;
+	for (int i = 0; i < code->count; i++) {
+		const ASTNode* node = code->stmts[i];
+		switch (node->type) {
+			case NODE_ASSIGN:
+				if (subst_env_lookup(seen, node->Assign.sym)) break;
+				subst_env_bind(seen, node->Assign.sym, (ASTNode*)node);
+				if (*count == *cap) {
+					*cap *= 2;
+					*out = realloc(*out, *cap * sizeof(int));
+					if (!*out) { perror("realloc"); exit(1); }
+				}
+				(*out)[(*count)++] = node->Assign.sym;
+				break;
+			case NODE_IF_ELSE:
+				collect_assigned(node->If.block_if, seen, out, count, cap);
+				collect_assigned(node->If.block_else, seen, out, count, cap);
+				break;
+			case NODE_WHILE:
+				collect_assigned(node->While.block_main, seen, out, count, cap);
+				break;
+			default:
+				break;
+		}
 	}
 }
 
+// Variables a block may change (nested blocks included), each once, in
+// order of first assignment. `*syms` is malloc'd; returns its length.
+int block_assigned(const DLL* code, int** syms) {
+	int count = 0, cap = 8;
+	*syms = malloc(cap * sizeof(int));
+	if (!*syms) { perror("malloc"); exit(1); }
+
+	SubstEnv* seen = create_SubstEnv();
+	collect_assigned(code, seen, syms, &count, &cap);
+	free_SubstEnv(seen);
+	return count;
+}
+
+// Fresh variable x<mark>k standing for an unknown value of x (x#3, x'1,
+// ...). The mark is not allowed in source identifiers, and each module
+// creating fresh names uses its own, so they never meet a program variable
+// or each other.
+ASTNode* create_node_fresh(int sym, char mark, int k) {
+	const char* base = symbol_name(sym);
+	char name[strlen(base) + 16];
+	snprintf(name, sizeof(name), "%s%c%d", base, mark, k);
+	return create_node_id(name);
+}
+
 // ==================== AST printing utilities ====================
 
+// Source text of an operator (inverse of the parser's mapping)
+const char* op_to_string(OpCode op) {
+	switch (op) {
+		case OP_ADD:	return "+";
+		case OP_SUB:	return "-";
+		case OP_MUL:	return "*";
+		case OP_DIV:	return "/";
+		case OP_MOD:	return "%";
+		case OP_LT:		return "<";
+		case OP_GT:		return ">";
+		case OP_LE:		return "<=";
+		case OP_GE:		return ">=";
+		case OP_EQ:		return "==";
+		case OP_NEQ:	return "!=";
+		case OP_AND:	return "and";
+		case OP_OR:		return "or";
+		case OP_IMPLY:	return "->";
+		case OP_NOT:	return "not";
+	}
+	return "?";
+}
+
+// Source name of a built-in function
+const char* func_to_string(FuncCode func) {
+	switch (func) {
+		case FUNC_MIN:	return "min";
+		case FUNC_MAX:	return "max";
+		case FUNC_FACT:	return "fact";
+	}
+	return "?";
+}
+
 // Print line number information when displaying nodes
 void print_line(int iter) {
 	if(iter != -1) {
@@ -150,47 +614,82 @@ void print_prof(int prof) {
 	}
 }
 
-// Recursive pretty-printer for AST nodes
-void print_ASTNode(ASTNode* node, int iter, int prof) {
+// Debug printer work items: a node, a text line, a statement list or a block
+typedef enum { PRINT_NODE, PRINT_TEXT, PRINT_LIST, PRINT_BLOCK } PrintKind;
+
+typedef struct {
+	PrintKind kind;
+	int iter;						// PRINT_NODE: statement number (-1: none); PRINT_LIST: index of the next statement
+	int prof;						// indentation
+	int pre;						// PRINT_BLOCK: print_DLL's `pre`
+	const char* text;
+	ASTNode* node;
+	DLL* block;						// PRINT_LIST, PRINT_BLOCK
+} PrintItem;
+
+static PrintItem print_node_item(ASTNode* node, int iter, int prof) {
+	return (PrintItem){ PRINT_NODE, iter, prof, 0, NULL, node, NULL };
+}
+
+static PrintItem print_text_item(int prof, const char* text) {
+	return (PrintItem){ PRINT_TEXT, 0, prof, 0, text, NULL, NULL };
+}
+
+static PrintItem print_block_item(DLL* block, int prof, int pre) {
+	return (PrintItem){ PRINT_BLOCK, 0, prof, pre, NULL, NULL, block };
+}
+
+// Push items so that they are printed in the order given
+static void push_print_items(WorkStack* stack, const PrintItem* items, int n) {
+	for (int i = n - 1; i >= 0; i--) *(PrintItem*)work_push(stack) = items[i];
+}
+
+// Print the header of a node and schedule what follows it
+static void print_node_step(WorkStack* stack, ASTNode* node, int iter, int prof) {
+	PrintItem next[10];
+	int n = 0;
+
 	if(node == NULL) {
 		printf("node is NULL");
 		return;
 	}
 
 	switch(node->type) {
-		case NODE_BIN_OP: {
+		case NODE_BIN_OP:
 			print_line(iter);
 			print_prof(prof);
-			printf("Node binary: %s\n", node->binary_op.op);
-
-			print_prof(prof);
-			printf("Left node: \n");
-			if (node->binary_op.left)
-				print_ASTNode(node->binary_op.left, -1, prof+1);
-			else
-				printf("NULL\n");
+			printf("Node binary: %s\n", op_to_string(node->binary_op.op));
+
+			next[n++] = print_text_item(prof, "Left node: \n");
+			next[n++] = node->binary_op.left
+				? print_node_item(node->binary_op.left, -1, prof+1)
+				: print_text_item(0, "NULL\n");
+			next[n++] = print_text_item(prof, "Right node: \n");
+			next[n++] = node->binary_op.right
+				? print_node_item(node->binary_op.right, -1, prof+1)
+				: print_text_item(0, "NULL\n");
+			break;
 
+		case NODE_NARY:
+			print_line(iter);
 			print_prof(prof);
-			printf("Right node: \n");
-			if (node->binary_op.right)
-				print_ASTNode(node->binary_op.right, -1, prof+1);
-			else
-				printf("NULL\n");
+			printf("Node n-ary: %s (%d operands)\n", op_to_string(node->nary.op), node->nary.count);
 
+			// any number of operands: pushed straight onto the stack, last first
+			for (int i = node->nary.count - 1; i >= 0; i--) {
+				*(PrintItem*)work_push(stack) = print_node_item(node->nary.args[i], -1, prof+1);
+			}
 			break;
-		};
 
-		case NODE_ID: {
+		case NODE_ID:
 			print_line(iter);
 			print_prof(prof);
 			printf("Node ID: \n");
 			print_prof(prof+1);
 			printf("%s\n",node->id_name);
-
 			break;
-		};
 
-		case NODE_NUMBER: {
+		case NODE_NUMBER:
 			print_line(iter);
 			print_prof(prof);
 			printf("Node NUMBER: \n");
@@ -198,9 +697,8 @@ void print_ASTNode(ASTNode* node, int iter, int prof) {
 			printf("%d", node->number);
 			printf("\n");
 			break;
-		};
 
-		case NODE_ASSIGN: {
+		case NODE_ASSIGN:
 			print_prof(prof-1);
 			print_line(iter);
 
@@ -213,94 +711,72 @@ void print_ASTNode(ASTNode* node, int iter, int prof) {
 			print_prof(prof);
 			printf("Expr: \n");
 
-			if (node->Assign.expr)
-				print_ASTNode(node->Assign.expr, -1, prof+1);
-			else
-				printf("NULL\n");
-
-			printf("\n");
+			next[n++] = node->Assign.expr
+				? print_node_item(node->Assign.expr, -1, prof+1)
+				: print_text_item(0, "NULL\n");
+			next[n++] = print_text_item(0, "\n");
 			break;
-		}
 
-		case NODE_IF_ELSE: {
+		case NODE_IF_ELSE:
 			print_line(iter);
 			print_prof(prof);
 			printf("Node IF ELSE:\n");
-			
+
 			print_prof(prof);
 			printf("condition : \n");
-			print_ASTNode(node->If.condition, -1, prof+1);
-			
-			printf("\n");
-			print_prof(prof);
-			printf("block IF : \n");
+			next[n++] = print_node_item(node->If.condition, -1, prof+1);
 
-			print_DLL(node->If.block_if, prof+1, -1);
-			printf("\n");
+			next[n++] = print_text_item(0, "\n");
+			next[n++] = print_text_item(prof, "block IF : \n");
+			next[n++] = print_block_item(node->If.block_if, prof+1, -1);
+			next[n++] = print_text_item(0, "\n");
 
-			print_prof(prof);
-			printf("block Else : \n");
-
-			print_DLL(node->If.block_else, prof+1, -1);
-			printf("\n");
+			next[n++] = print_text_item(prof, "block Else : \n");
+			next[n++] = print_block_item(node->If.block_else, prof+1, -1);
+			next[n++] = print_text_item(0, "\n");
 			break;
-		};
 
-		case NODE_FUNCTION: {
+		case NODE_FUNCTION:
 			print_line(iter);
 			print_prof(prof);
 			printf("Node Function:\n");
 
 			print_prof(prof);
-			printf("Function name: %s\n", node->function.fname);
-
-			print_prof(prof);
-			printf("Expr arg1: \n");
-			if (node->function.arg1)
-				print_ASTNode(node->function.arg1, -1, prof+1);
-			else
-				printf("NULL\n");
-
-			print_prof(prof);
-			printf("Expr arg2: \n");
-			if (node->function.arg2)
-				print_ASTNode(node->function.arg2, -1, prof+1);
-			else
-				print_prof(prof+1);
-				printf("NULL\n");
-
+			printf("Function name: %s\n", func_to_string(node->function.func));
+
+			next[n++] = print_text_item(prof, "Expr arg1: \n");
+			next[n++] = node->function.arg1
+				? print_node_item(node->function.arg1, -1, prof+1)
+				: print_text_item(0, "NULL\n");
+			next[n++] = print_text_item(prof, "Expr arg2: \n");
+			next[n++] = node->function.arg2
+				? print_node_item(node->function.arg2, -1, prof+1)
+				: print_text_item(prof+1, "NULL\n");
 			break;
-		}
 
-		case NODE_WHILE: {
+		case NODE_WHILE:
 			print_prof(prof-1);
 			print_line(iter);
 			print_prof(prof);
 			printf("Node WHILE:\n");
-			
-			print_prof(prof);
-			printf("condition : \n");
-			print_ASTNode(node->While.condition, -1, prof+1);
 
 			print_prof(prof);
-			printf("Invariant : \n");
-			print_ASTNode(node->While.invariant, -1, prof+1);
+			printf("condition : \n");
+			next[n++] = print_node_item(node->While.condition, -1, prof+1);
 
-			print_prof(prof);
-			printf("Variant : \n");
-			print_ASTNode(node->While.variant, -1, prof+1);
+			next[n++] = print_text_item(prof, "Invariant : \n");
+			next[n++] = print_node_item(node->While.invariant, -1, prof+1);
 
+			next[n++] = print_text_item(prof, "Variant : \n");
+			next[n++] = print_node_item(node->While.variant, -1, prof+1);
 
-			printf("\n");
-			print_prof(prof);
-			printf("block : \n");
-			print_DLL(node->While.block_main, prof+1, -1);
-			printf("\n");
+			next[n++] = print_text_item(0, "\n");
+			next[n++] = print_text_item(prof, "block : \n");
+			next[n++] = print_block_item(node->While.block_main, prof+1, -1);
+			next[n++] = print_text_item(0, "\n");
 			break;
-			
-		};
 
-		case NODE_BOOL: {
+		case NODE_BOOL:
 			print_prof(prof);
 			print_line(iter);
 			printf("Node Bool: \n");
@@ -310,345 +786,885 @@ void print_ASTNode(ASTNode* node, int iter, int prof) {
 
 			printf("\n");
 			break;
-		}
 
-		case NODE_UNARY_OP: {
+		case NODE_LABEL:
 			print_prof(prof);
 			print_line(iter);
-			printf("Node Unary: %s \n", node->unary_op.op);
+			printf("Node Label: %s \n", node->label.text);
 
 			print_prof(prof);
 			printf("Child : \n");
-			print_ASTNode(node->unary_op.child, -1, prof+1);
+			next[n++] = print_node_item(node->label.child, -1, prof+1);
 			break;
-		}
-			
+
+		case NODE_ITE:
+			print_prof(prof);
+			print_line(iter);
+			printf("Node Ite: \n");
+
+			print_prof(prof);
+			printf("condition : \n");
+			next[n++] = print_node_item(node->ite.condition, -1, prof+1);
+
+			next[n++] = print_text_item(prof, "then : \n");
+			next[n++] = print_node_item(node->ite.then_term, -1, prof+1);
+
+			next[n++] = print_text_item(prof, "else : \n");
+			next[n++] = print_node_item(node->ite.else_term, -1, prof+1);
+			break;
+
+		case NODE_UNARY_OP:
+			print_prof(prof);
+			print_line(iter);
+			printf("Node Unary: %s \n", op_to_string(node->unary_op.op));
+
+			print_prof(prof);
+			printf("Child : \n");
+			next[n++] = print_node_item(node->unary_op.child, -1, prof+1);
+			break;
+
 		default:
 			print_line(iter);
 			printf("Unknown node type: %d\n", node->type);
 			printf("\n");
 			break;
 	}
+
+	push_print_items(stack, next, n);
 }
 
-// Print all nodes in a linked list of lines (statements)
-void print_line_linkedlist(line_linkedlist* list, int prof) {
-	int num = 1;
-	int p = 1 + prof;
+// Print a block: its statements, then (pre == 0) its pre/postcondition
+static void print_block_step(WorkStack* stack, DLL* dll, int prof, int pre) {
+	if(dll == NULL) {
+		printf("DLL is NULL\n");
+		return;
+	}
+
+	if(dll->count == 0 ){
+		printf("DLL is empty\n");
+	}
 
-	while(list != NULL) {
-		if (list->node == NULL) {
-			printf("Null node in linked list\n");
-		} else {
-			print_ASTNode(list->node, num, p);
+	PrintItem next[5];
+	int n = 0;
+	next[n++] = (PrintItem){ PRINT_LIST, 0, 1 + prof, 0, NULL, NULL, dll };
+	if(pre == 0) {
+		next[n++] = print_text_item(0, "PRECONDITON: \n");
+		next[n++] = print_node_item(dll->pre, 1, prof+1);
+		next[n++] = print_text_item(0, "POSTCONDITON: \n");
+		next[n++] = print_node_item(dll->post, 1, prof+1);
+	}
+	push_print_items(stack, next, n);
+}
+
+// Run the printer until every scheduled item is printed. Nesting only
+// grows the explicit stack; a statement list takes one slot at a time.
+static void run_printer(PrintItem first) {
+	WorkStack stack;
+	work_init(&stack, sizeof(PrintItem));
+	*(PrintItem*)work_push(&stack) = first;
+
+	PrintItem* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		PrintItem item = *top;
+
+		switch (item.kind) {
+			case PRINT_NODE:
+				print_node_step(&stack, item.node, item.iter, item.prof);
+				break;
+
+			case PRINT_TEXT:
+				print_prof(item.prof);
+				fputs(item.text, stdout);
+				break;
+
+			case PRINT_LIST: {
+				if (item.iter >= item.block->count) break;
+				// the rest of the block goes below the current statement
+				ASTNode* stmt = item.block->stmts[item.iter];
+				*(PrintItem*)work_push(&stack) = (PrintItem){ PRINT_LIST, item.iter + 1, item.prof, 0, NULL, NULL, item.block };
+				if (stmt == NULL) {
+					printf("Null node in block\n");
+				} else {
+					*(PrintItem*)work_push(&stack) = print_node_item(stmt, item.iter + 1, item.prof);
+				}
+				break;
+			}
+
+			case PRINT_BLOCK:
+				print_block_step(&stack, item.block, item.prof, item.pre);
+				break;
 		}
-		list = list->next;
-		num++;
 	}
+	work_free(&stack);
+}
+
+// Pretty-printer for AST nodes (debugging)
+void print_ASTNode(ASTNode* node, int iter, int prof) {
+	run_printer(print_node_item(node, iter, prof));
 }
 
 // Print the entire DLL (program block + pre/post conditions if requested)
 void print_DLL(DLL* dll, int prof, int pre) {
-	if(dll == NULL) {
-		printf("DLL is NULL\n");
-		return;
-	}
+	run_printer(print_block_item(dll, prof, pre));
+}
 
-	if(dll->first == NULL ){
-		printf("DLL first is NULL\n");
+// ==================== Infix formula printing ====================
+
+// Binding strength of an operator, mirroring the %left/%right list in parser.y
+static int op_precedence(OpCode op) {
+	switch (op) {
+		case OP_IMPLY:	return 1;
+		case OP_OR:		return 2;
+		case OP_AND:	return 3;
+		case OP_NOT:	return 4;
+		case OP_LT: case OP_GT: case OP_LE: case OP_GE: case OP_EQ: case OP_NEQ:
+						return 5;
+		case OP_ADD: case OP_SUB:
+						return 6;
+		case OP_MUL: case OP_DIV: case OP_MOD:
+						return 7;
 	}
-	print_line_linkedlist(dll->first, prof);
+	return 0;
+}
 
+// Precedence of a node when it appears as an operand (atoms bind tightest)
+static int node_precedence(const ASTNode* node) {
+	while (node->type == NODE_LABEL && node->label.child) node = node->label.child;
+	if (node->type == NODE_BIN_OP) return op_precedence(node->binary_op.op);
+	if (node->type == NODE_NARY) return op_precedence(node->nary.op);
+	if (node->type == NODE_UNARY_OP) return op_precedence(node->unary_op.op);
+	return 10;
+}
 
-	if(pre == 0) {
-		printf("PRECONDITON: \n");
-		print_ASTNode(dll->pre, 1, prof+1);
+// Infix printer work items: a formula, an operand (parenthesized when it
+// binds weaker than min_prec) or a piece of text
+typedef enum { FORMULA_NODE, FORMULA_OPERAND, FORMULA_TEXT } FormulaKind;
 
-		printf("POSTCONDITON: \n");
-		print_ASTNode(dll->post, 1, prof+1);
-	}
+typedef struct {
+	FormulaKind kind;
+	int min_prec;
+	const ASTNode* node;
+	const char* text;
+} FormulaItem;
 
+static FormulaItem formula_node(const ASTNode* node) {
+	return (FormulaItem){ FORMULA_NODE, 0, node, NULL };
 }
 
-// ==================== Deep copying ====================
+static FormulaItem formula_operand(const ASTNode* node, int min_prec) {
+	return (FormulaItem){ FORMULA_OPERAND, min_prec, node, NULL };
+}
 
-// Clone a DLL (deep copy of all AST nodes inside)
-DLL* clone_DLL(const DLL* src) {
-	if (!src) return NULL;
-	DLL* out = (DLL*)malloc(sizeof(DLL));
-	if (!out) { perror("malloc"); exit(1); }
+static FormulaItem formula_text(const char* text) {
+	return (FormulaItem){ FORMULA_TEXT, 0, NULL, text };
+}
 
-	out->pre  = clone_node(src->pre);
-	out->post = clone_node(src->post);
-	out->first = out->last = NULL;
-
-	line_linkedlist* prev = NULL;
-	for (line_linkedlist* cur = src->first; cur; cur = cur->next) {
-		line_linkedlist* nln = (line_linkedlist*)malloc(sizeof(line_linkedlist));
-		if (!nln) { perror("malloc"); exit(1); }
-		nln->node = clone_node(cur->node);
-		nln->next = NULL;
-		nln->prec = prev;
-		if (prev) prev->next = nln;
-		else out->first = nln;
-		prev = nln;
-	}
-	out->last = prev;
-	return out;
+static void push_formula_items(WorkStack* stack, const FormulaItem* items, int n) {
+	for (int i = n - 1; i >= 0; i--) *(FormulaItem*)work_push(stack) = items[i];
 }
 
-// Clone a single AST node (deep copy)
-ASTNode* clone_node(const ASTNode* src) {
-	if (!src) return NULL;
+// Print what comes before the first child of a node, schedule the rest
+static void fprint_formula_step(FILE* out, WorkStack* stack, const ASTNode* node) {
+	FormulaItem next[6];
+	int n = 0;
 
-	ASTNode* dst = alloc_node(src->type);
+	if (!node) {
+		fputs("NULL", out);
+		return;
+	}
 
-	switch (src->type) {
-		case NODE_ASSIGN:
-			dst->Assign.id   = src->Assign.id ? strdup(src->Assign.id) : NULL;
-			dst->Assign.expr = clone_node(src->Assign.expr);
+	switch (node->type) {
+		case NODE_NUMBER:	fprintf(out, "%d", node->number); break;
+		case NODE_BOOL:		fputs(node->bool_value ? "true" : "false", out); break;
+		case NODE_ID:		fputs(node->id_name, out); break;
+
+		case NODE_BIN_OP: {
+			OpCode op = node->binary_op.op;
+			int prec = op_precedence(op);
+			// -> is right associative, comparisons don't chain, the rest is left associative
+			int left_min = (op == OP_IMPLY || prec == 5) ? prec + 1 : prec;
+			int right_min = (op == OP_IMPLY) ? prec : prec + 1;
+
+			next[n++] = formula_operand(node->binary_op.left, left_min);
+			next[n++] = formula_text(" ");
+			next[n++] = formula_text(op_to_string(op));
+			next[n++] = formula_text(" ");
+			next[n++] = formula_operand(node->binary_op.right, right_min);
 			break;
+		}
 
-		case NODE_FUNCTION:
-			dst->function.fname = src->function.fname ? strdup(src->function.fname) : NULL;
-			dst->function.arg1  = clone_node(src->function.arg1);
-			dst->function.arg2  = clone_node(src->function.arg2);
+		case NODE_NARY: {
+			// printed as the left associative chain it stands for, last operand pushed first
+			int prec = op_precedence(node->nary.op);
+			for (int i = node->nary.count - 1; i >= 0; i--) {
+				*(FormulaItem*)work_push(stack) = formula_operand(node->nary.args[i], i ? prec + 1 : prec);
+				if (i) {
+					FormulaItem sep[3] = { formula_text(" "), formula_text(op_to_string(node->nary.op)), formula_text(" ") };
+					push_formula_items(stack, sep, 3);
+				}
+			}
 			break;
+		}
 
-		case NODE_IF_ELSE:
-			dst->If.condition  = clone_node(src->If.condition);
-			dst->If.block_if   = clone_DLL(src->If.block_if);
-			dst->If.block_else = clone_DLL(src->If.block_else);
+		case NODE_UNARY_OP:
+			fprintf(out, "%s ", op_to_string(node->unary_op.op));
+			next[n++] = formula_operand(node->unary_op.child, 10);
 			break;
 
-		case NODE_WHILE:
-			dst->While.condition  = clone_node(src->While.condition);
-			dst->While.invariant  = clone_node(src->While.invariant);
-			dst->While.variant    = clone_node(src->While.variant);
-			dst->While.block_main = clone_DLL(src->While.block_main);
+		case NODE_FUNCTION:
+			fprintf(out, "%s(", func_to_string(node->function.func));
+			next[n++] = formula_node(node->function.arg1);
+			if (node->function.arg2) {
+				next[n++] = formula_text(", ");
+				next[n++] = formula_node(node->function.arg2);
+			}
+			next[n++] = formula_text(")");
 			break;
 
-		case NODE_BIN_OP:
-			dst->binary_op.op    = src->binary_op.op ? strdup(src->binary_op.op) : NULL;
-			dst->binary_op.left  = clone_node(src->binary_op.left);
-			dst->binary_op.right = clone_node(src->binary_op.right);
+		case NODE_LABEL:
+			next[n++] = formula_node(node->label.child);
 			break;
 
-		case NODE_UNARY_OP:
-			dst->unary_op.op    = src->unary_op.op ? strdup(src->unary_op.op) : NULL;
-			dst->unary_op.child = clone_node(src->unary_op.child);
+		case NODE_ITE:
+			fputs("ite(", out);
+			next[n++] = formula_node(node->ite.condition);
+			next[n++] = formula_text(", ");
+			next[n++] = formula_node(node->ite.then_term);
+			next[n++] = formula_text(", ");
+			next[n++] = formula_node(node->ite.else_term);
+			next[n++] = formula_text(")");
 			break;
 
-		case NODE_ID:
-			dst->id_name = src->id_name ? strdup(src->id_name) : NULL;
+		case NODE_ASSIGN:
+			fprintf(out, "%s = ", node->Assign.id);
+			next[n++] = formula_node(node->Assign.expr);
+			next[n++] = formula_text(";");
 			break;
 
-		case NODE_NUMBER:
-			dst->number = src->number;
+		case NODE_IF_ELSE:
+			fputs("if (", out);
+			next[n++] = formula_node(node->If.condition);
+			next[n++] = formula_text(") { ... }");
 			break;
 
-		case NODE_BOOL:
-			dst->bool_value = src->bool_value;
+		case NODE_WHILE:
+			fputs("while (", out);
+			next[n++] = formula_node(node->While.condition);
+			next[n++] = formula_text(") { ... }");
 			break;
 
 		default:
-			fprintf(stderr, "clone_node: unknown type %d\n", src->type);
+			fprintf(out, "<node %d>", node->type);
 			break;
 	}
 
-	return dst;
+	push_formula_items(stack, next, n);
+}
+
+// Print an expression/formula back in the input syntax
+void fprint_formula(FILE* out, const ASTNode* node) {
+	WorkStack stack;
+	work_init(&stack, sizeof(FormulaItem));
+	*(FormulaItem*)work_push(&stack) = formula_node(node);
+
+	FormulaItem* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		FormulaItem item = *top;
+
+		if (item.kind == FORMULA_TEXT) {
+			fputs(item.text, out);
+		} else if (item.kind == FORMULA_NODE) {
+			fprint_formula_step(out, &stack, item.node);
+		} else if (item.node && node_precedence(item.node) < item.min_prec) {
+			FormulaItem wrapped[3] = { formula_text("("), formula_node(item.node), formula_text(")") };
+			push_formula_items(&stack, wrapped, 3);
+		} else {
+			*(FormulaItem*)work_push(&stack) = formula_node(item.node);
+		}
+	}
+	work_free(&stack);
+}
+
+// Render a formula as text in the AST arena
+char* formula_to_string(const ASTNode* node) {
+	char* buf = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&buf, &len);
+	if (!out) { perror("open_memstream"); exit(1); }
+
+	fprint_formula(out, node);
+	fclose(out);
+
+	char* res = ast_strdup(buf);
+	free(buf);
+	return res;
+}
+
+// ==================== Deep copying ====================
+
+// Clone a DLL (deep copy of all AST nodes inside; O(1) when sharing)
+DLL* clone_DLL(const DLL* src) {
+	if (!src) return NULL;
+	if (sharing_enabled) return (DLL*)src; // blocks are immutable too
+	DLL* out = ast_alloc(sizeof(DLL));
+
+	out->pre  = clone_node(src->pre);
+	out->post = clone_node(src->post);
+	out->count = out->capacity = src->count;
+	out->stmts = src->count ? ast_alloc(src->count * sizeof(ASTNode*)) : NULL;
+	for (int i = 0; i < src->count; i++) out->stmts[i] = clone_node(src->stmts[i]);
+	return out;
+}
+
+static ASTNode* copy_tree(const ASTNode* root, int sym, const ASTNode* repl);
+
+// Clone a single AST node (deep copy; arena-owned strings are shared).
+// With sharing enabled nodes are immutable, so the clone is the node itself.
+ASTNode* clone_node(const ASTNode* src) {
+	if (!src) return NULL;
+	stats_count(COUNTER_CLONE, 1);
+	if (sharing_enabled) return (ASTNode*)src;
+	return copy_tree(src, 0, NULL);
 }
 
 // ==================== Substitution ====================
 
-// Substitute all occurrences of `id` in AST/DLL with the replacement node `repl`
-DLL* substitute_DLL(const DLL* src, const char* id, const ASTNode* repl) {
+// Substitute all occurrences of symbol `sym` in AST/DLL with the replacement node `repl`
+DLL* substitute_DLL(const DLL* src, int sym, const ASTNode* repl) {
 	if (!src) return NULL;
-	DLL* out = (DLL*)malloc(sizeof(DLL));
-	if (!out) { perror("malloc"); exit(1); }
+	DLL* out = ast_alloc(sizeof(DLL));
 
 	// Substitute in pre/post conditions
-	out->pre  = substitute(src->pre, id, repl);
-	out->post = substitute(src->post, id, repl);
-	out->first = out->last = NULL;
+	out->pre  = substitute(src->pre, sym, repl);
+	out->post = substitute(src->post, sym, repl);
 
-	line_linkedlist* prev = NULL;
-	for (line_linkedlist* cur = src->first; cur; cur = cur->next) {
-		// create a new linked list element for each node
-		line_linkedlist* nln = (line_linkedlist*)malloc(sizeof(line_linkedlist));
-		if (!nln) { perror("malloc"); exit(1); }
+	// one new array, each statement substituted in place
+	out->count = out->capacity = src->count;
+	out->stmts = src->count ? ast_alloc(src->count * sizeof(ASTNode*)) : NULL;
+	for (int i = 0; i < src->count; i++) out->stmts[i] = substitute(src->stmts[i], sym, repl);
+	return out;
+}
 
-		// recursively substitute inside the ASTNode
-		nln->node = substitute(cur->node, id, repl);
-		nln->next = NULL;
-		nln->prec = prev;
+// Blocks of a copied if/while: substituted (sym 0: cloned) statement by statement
+static void copy_blocks(ASTNode* dst, int sym, const ASTNode* repl) {
+	if (dst->type == NODE_IF_ELSE) {
+		dst->If.block_if   = sym ? substitute_DLL(dst->If.block_if, sym, repl) : clone_DLL(dst->If.block_if);
+		dst->If.block_else = sym ? substitute_DLL(dst->If.block_else, sym, repl) : clone_DLL(dst->If.block_else);
+	} else if (dst->type == NODE_WHILE) {
+		dst->While.block_main = sym ? substitute_DLL(dst->While.block_main, sym, repl) : clone_DLL(dst->While.block_main);
+	}
+}
+
+// Tree substitution: a copy of `root` with `sym` replaced by a copy of
+// `repl` (sym 0: a plain copy). Built top-down; each frame is a source node
+// and the slot its copy goes into, so the native stack stays flat however
+// deep the tree is.
+static ASTNode* copy_tree(const ASTNode* root, int sym, const ASTNode* repl) {
+	typedef struct { const ASTNode* src; ASTNode** slot; } CopyFrame;
+
+	ASTNode* result = NULL;
+	WorkStack stack;
+	work_init(&stack, sizeof(CopyFrame));
+	*(CopyFrame*)work_push(&stack) = (CopyFrame){ root, &result };
+
+	CopyFrame* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		const ASTNode* src = top->src;
+		ASTNode** slot = top->slot;
+
+		if (sym && src->type == NODE_ID && src->id_sym == sym) {
+			*slot = clone_node(repl);
+			continue;
+		}
 
-		if (prev) prev->next = nln;
-		else out->first = nln; // first element in the new DLL
-		
-		prev = nln;
+		ASTNode* dst = alloc_node(src->type);
+		*dst = *src; // literals, names and operators; children are replaced below
+		*slot = dst;
+		copy_operands(dst);
+		copy_blocks(dst, sym, repl);
+
+		for (int i = child_count(dst) - 1; i >= 0; i--) {
+			ASTNode** kid = child_slot(dst, i);
+			if (*kid) *(CopyFrame*)work_push(&stack) = (CopyFrame){ *kid, kid };
+		}
 	}
 
-	out->last = prev;
-	return out;
+	work_free(&stack);
+	return result;
 }
 
-// Recursively traverse an ASTNode and replace occurrences of `id` with `repl`.
-ASTNode* substitute(const ASTNode* node, const char* id, const ASTNode* repl) {
-	if (!node) return NULL;
-	if (!id) return clone_node(node);
+// Statements are not shared: copy the node itself, substitute below it
+static ASTNode* substitute_statement(const ASTNode* node, int sym, const ASTNode* repl) {
+	ASTNode* out = alloc_node(node->type);
+	*out = *node;
+	copy_blocks(out, sym, repl);
 
-	switch (node->type) {
-		case NODE_ID:
-			if (node->id_name && strcmp(node->id_name, id) == 0)
-				return clone_node(repl);
-			else
-				return clone_node(node);
+	for (int i = 0; i < child_count(out); i++) {
+		ASTNode** kid = child_slot(out, i);
+		*kid = substitute(*kid, sym, repl);
+	}
+	return out;
+}
 
-		case NODE_NUMBER:
-		case NODE_BOOL:
-			return clone_node(node); // literals are unchanged
+// `node` over the rewritten children found in `memo`. An unchanged node is
+// kept when `keep` is set, rebuilt ones go through the share table.
+static ASTNode* rebuild_node(const ASTNode* node, PtrMap* memo, int keep) {
+	int n = child_count(node);
+	ASTNode* small[3];
+	ASTNode** sub = n <= 3 ? small : malloc(n * sizeof(ASTNode*));
+	if (!sub) { perror("malloc"); exit(1); }
+
+	int changed = 0;
+	for (int i = 0; i < n; i++) {
+		const ASTNode* kid = child_at(node, i);
+		sub[i] = kid ? ptrmap_get(memo, kid) : NULL;
+		if (sub[i] != kid) changed = 1;
+	}
 
-		case NODE_ASSIGN: {
-			ASTNode* out = alloc_node(NODE_ASSIGN);
-			out->Assign.id   = node->Assign.id ? strdup(node->Assign.id) : NULL;
-			out->Assign.expr = substitute(node->Assign.expr, id, repl);
-			return out;
+	ASTNode* res;
+	if (keep && !changed) {
+		res = (ASTNode*)node;
+	} else {
+		switch (node->type) {
+			case NODE_BIN_OP:	res = create_node_binary(node->binary_op.op, sub[0], sub[1]); break;
+			case NODE_UNARY_OP:	res = create_node_unary(node->unary_op.op, sub[0]); break;
+			case NODE_LABEL:	res = create_node_label(node->label.text, sub[0]); break;
+			case NODE_ITE:		res = create_node_ite(sub[0], sub[1], sub[2]); break;
+			case NODE_NARY:		res = nary_node(node->nary.op, sub, n); break;	// shape kept (no splicing)
+			default:			res = create_node_Func(node->function.func, sub[0], sub[1]); break;
 		}
+	}
+	if (sub != small) free(sub);
+	return res;
+}
 
-		case NODE_FUNCTION: {
-			ASTNode* out = alloc_node(NODE_FUNCTION);
-			out->function.fname = node->function.fname ? strdup(node->function.fname) : NULL;
-			out->function.arg1  = substitute(node->function.arg1, id, repl);
-			out->function.arg2  = substitute(node->function.arg2, id, repl);
-			return out;
+// Substitution over a DAG, bottom-up: a node is rebuilt once all its
+// children are in `memo`, so every distinct node is visited once however
+// often it is referenced. With `env` all its bindings are applied at once,
+// otherwise `sym` is replaced by `repl`. Replacement terms are referenced
+// rather than copied (arena nodes are immutable).
+static ASTNode* substitute_dag(const ASTNode* root, const SubstEnv* env, int sym, const ASTNode* repl, PtrMap* memo) {
+	typedef struct { const ASTNode* node; int expanded; } DagFrame;
+
+	WorkStack stack;
+	work_init(&stack, sizeof(DagFrame));
+	*(DagFrame*)work_push(&stack) = (DagFrame){ root, 0 };
+
+	DagFrame* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		DagFrame frame = *top;
+		const ASTNode* node = frame.node;
+		if (ptrmap_get(memo, node)) continue;
+
+		ASTNode* res;
+
+		switch (node->type) {
+			case NODE_ID: {
+				ASTNode* term = env ? subst_env_lookup(env, node->id_sym)
+					: (node->id_sym == sym ? (ASTNode*)repl : NULL);
+				res = term ? term : clone_node(node);
+				break;
+			}
+
+			case NODE_NUMBER:
+			case NODE_BOOL:
+				res = clone_node(node); // literals are unchanged
+				break;
+
+			case NODE_BIN_OP:
+			case NODE_UNARY_OP:
+			case NODE_LABEL:
+			case NODE_ITE:
+			case NODE_FUNCTION:
+			case NODE_NARY:
+				if (!frame.expanded) {
+					// come back once the children are done
+					*(DagFrame*)work_push(&stack) = (DagFrame){ node, 1 };
+					for (int i = child_count(node) - 1; i >= 0; i--) {
+						const ASTNode* kid = child_at(node, i);
+						if (kid && !ptrmap_get(memo, kid)) *(DagFrame*)work_push(&stack) = (DagFrame){ kid, 0 };
+					}
+					continue;
+				}
+				res = rebuild_node(node, memo, sharing_enabled);
+				break;
+
+			default:
+				if (env) {
+					fprintf(stderr, "substitute_env: unsupported node type %d\n", node->type);
+					res = clone_node(node);
+				} else {
+					res = substitute_statement(node, sym, repl);
+				}
+				break;
 		}
 
-		case NODE_BIN_OP: {
-			ASTNode* out = alloc_node(NODE_BIN_OP);
-			out->binary_op.op    = node->binary_op.op ? strdup(node->binary_op.op) : NULL;
-			out->binary_op.left  = substitute(node->binary_op.left, id, repl);
-			out->binary_op.right = substitute(node->binary_op.right, id, repl);
-			return out;
+		ptrmap_put(memo, node, res);
+	}
+
+	work_free(&stack);
+	return ptrmap_get(memo, root);
+}
+
+// Replace occurrences of symbol `sym` with `repl` (returns a new AST, or
+// shares unchanged subterms when hash-consing is enabled).
+ASTNode* substitute(const ASTNode* node, int sym, const ASTNode* repl) {
+	if (!node) return NULL;
+	stats_count(COUNTER_SUBSTITUTE, 1);
+	if (!sym) return clone_node(node);
+
+	if (sharing_enabled) {
+		PtrMap* memo = create_PtrMap(64);
+		ASTNode* res = substitute_dag(node, NULL, sym, repl, memo);
+		free_PtrMap(memo);
+		return res;
+	}
+	return copy_tree(node, sym, repl);
+}
+
+// ==================== Simultaneous substitution ====================
+
+SubstEnv* create_SubstEnv(void) {
+	SubstEnv* env = malloc(sizeof(SubstEnv));
+	if (!env) { perror("malloc"); exit(1); }
+
+	env->capacity = 16;
+	env->count = 0;
+	env->syms = calloc(env->capacity, sizeof(int));
+	env->terms = calloc(env->capacity, sizeof(ASTNode*));
+	if (!env->syms || !env->terms) { perror("calloc"); exit(1); }
+	return env;
+}
+
+// Slot holding `sym`, or the empty slot where it would go
+static int subst_env_slot(const SubstEnv* env, int sym) {
+	int mask = env->capacity - 1;
+	int i = (int)(((unsigned)sym * 2654435761u) & (unsigned)mask);
+	while (env->syms[i] && env->syms[i] != sym) i = (i + 1) & mask;
+	return i;
+}
+
+// Replacement bound to `sym`, NULL when the variable is left unchanged
+ASTNode* subst_env_lookup(const SubstEnv* env, int sym) {
+	return env->terms[subst_env_slot(env, sym)];
+}
+
+// Bind (or rebind) sym := term; the env keeps pointers, not copies
+void subst_env_bind(SubstEnv* env, int sym, ASTNode* term) {
+	if ((env->count + 1) * 2 > env->capacity) {
+		int* old_syms = env->syms;
+		ASTNode** old_terms = env->terms;
+		int old_capacity = env->capacity;
+
+		env->capacity *= 2;
+		env->count = 0;
+		env->syms = calloc(env->capacity, sizeof(int));
+		env->terms = calloc(env->capacity, sizeof(ASTNode*));
+		if (!env->syms || !env->terms) { perror("calloc"); exit(1); }
+
+		for (int i = 0; i < old_capacity; i++) {
+			if (old_syms[i]) subst_env_bind(env, old_syms[i], old_terms[i]);
 		}
+		free(old_syms);
+		free(old_terms);
+	}
+
+	int i = subst_env_slot(env, sym);
+	if (!env->syms[i]) {
+		env->syms[i] = sym;
+		env->count++;
+	}
+	env->terms[i] = term;
+}
+
+// Apply all bindings of env at once in a single traversal (see substitute_dag)
+ASTNode* substitute_env(const ASTNode* node, const SubstEnv* env) {
+	if (!node) return NULL;
+	stats_count(COUNTER_SUBSTITUTE, 1);
+	if (env->count == 0) return clone_node(node);
+
+	PtrMap* memo = create_PtrMap(64);
+	ASTNode* res = substitute_dag(node, env, 0, NULL, memo);
+	free_PtrMap(memo);
+	return res;
+}
+
+// Independent copy of env (same terms, so it can be extended separately)
+SubstEnv* copy_SubstEnv(const SubstEnv* env) {
+	SubstEnv* copy = create_SubstEnv();
+	for (int i = 0; i < env->capacity; i++) {
+		if (env->syms[i]) subst_env_bind(copy, env->syms[i], env->terms[i]);
+	}
+	return copy;
+}
+
+void free_SubstEnv(SubstEnv* env) {
+	if (!env) return;
+	free(env->syms);
+	free(env->terms);
+	free(env);
+}
+
+// ==================== Flattening of associative chains ====================
+
+// Is `node` an inner link of a chain of `op` (binary or already n-ary)?
+static int chain_link(const ASTNode* node, OpCode op) {
+	return (node->type == NODE_BIN_OP && node->binary_op.op == op)
+		|| (node->type == NODE_NARY && node->nary.op == op);
+}
 
-		case NODE_UNARY_OP: {
-			ASTNode* out = alloc_node(NODE_UNARY_OP);
-			out->unary_op.op    = node->unary_op.op ? strdup(node->unary_op.op) : NULL;
-			out->unary_op.child = substitute(node->unary_op.child, id, repl);
-			return out;
+// Operands of the chain of `op` rooted at `root`, left to right, appended
+// to `out` (a WorkStack of node pointers): a and (b and c) -> a, b, c.
+// A link referenced more than once (`refs`) is an operand: it is
+// flattened once on its own rather than copied into every chain using it.
+static void chain_operands(const ASTNode* root, OpCode op, PtrMap* refs, WorkStack* out) {
+	WorkStack stack;
+	work_init(&stack, sizeof(const ASTNode*));
+	*(const ASTNode**)work_push(&stack) = root;
+
+	const ASTNode** top;
+	while ((top = work_pop(&stack)) != NULL) {
+		const ASTNode* node = *top;
+		if (!chain_link(node, op) || (node != root && (uintptr_t)ptrmap_get(refs, node) > 1)) {
+			*(const ASTNode**)work_push(out) = node;
+			continue;
 		}
+		for (int i = child_count(node) - 1; i >= 0; i--) *(const ASTNode**)work_push(&stack) = child_at(node, i);
+	}
+	work_free(&stack);
+}
 
-		case NODE_IF_ELSE: {
-			ASTNode* out = alloc_node(NODE_IF_ELSE);
-			out->If.condition  = substitute(node->If.condition, id, repl);
+// Operator of the chain rooted at `node`, -1 when it is not one
+static int chain_op(const ASTNode* node) {
+	if (node->type == NODE_BIN_OP && is_associative_op(node->binary_op.op)) return node->binary_op.op;
+	if (node->type == NODE_NARY) return node->nary.op;
+	return -1;
+}
 
-			out->If.block_if   = node->If.block_if   ? substitute_DLL(node->If.block_if, id, repl) : NULL;
-			out->If.block_else = node->If.block_else ? substitute_DLL(node->If.block_else, id, repl) : NULL;
-			return out;
+// Number of references to each node below `root` (edges of the DAG, so
+// x + x counts x twice), stored directly in the value slots of `refs`
+static void count_refs(const ASTNode* root, PtrMap* refs) {
+	WorkStack stack;
+	work_init(&stack, sizeof(const ASTNode*));
+	*(const ASTNode**)work_push(&stack) = root;
+
+	const ASTNode** top;
+	while ((top = work_pop(&stack)) != NULL) {
+		const ASTNode* node = *top;
+		for (int i = 0; i < child_count(node); i++) {
+			const ASTNode* kid = child_at(node, i);
+			if (!kid) continue;
+			uintptr_t n = (uintptr_t)ptrmap_get(refs, kid);
+			ptrmap_put(refs, kid, (void*)(n + 1));
+			if (n == 0) *(const ASTNode**)work_push(&stack) = kid;
 		}
+	}
+	work_free(&stack);
+}
 
-		case NODE_WHILE: {
-			ASTNode* out = alloc_node(NODE_WHILE);
-			out->While.condition  = substitute(node->While.condition, id, repl);
-			out->While.invariant  = substitute(node->While.invariant, id, repl);
-			out->While.variant    = substitute(node->While.variant, id, repl);
-			out->While.block_main = node->While.block_main ? substitute_DLL(node->While.block_main, id, repl) : NULL;
-			return out;
+// Copy of a formula where every maximal chain of and, or, +, * becomes one
+// n-ary node. The whole chain is collected when its root is met, so the
+// cost is linear in the size of the formula, unlike re-flattening at each
+// binary construction. Bottom-up over the DAG like substitute_dag;
+// untouched subterms are kept. Chains stop at shared links (see
+// chain_operands), so the result has at most as many nodes as the input
+// DAG: `x = x + x` repeated k times stays k nodes, not 2^k operands.
+ASTNode* flatten_formula(const ASTNode* root) {
+	typedef struct { const ASTNode* node; int expanded; } FlattenFrame;
+
+	if (!root) return NULL;
+	PtrMap* memo = create_PtrMap(64);
+	PtrMap* refs = create_PtrMap(64);
+	count_refs(root, refs);
+	WorkStack stack, chain;
+	work_init(&stack, sizeof(FlattenFrame));
+	work_init(&chain, sizeof(const ASTNode*));
+	*(FlattenFrame*)work_push(&stack) = (FlattenFrame){ root, 0 };
+
+	FlattenFrame* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		FlattenFrame frame = *top;
+		const ASTNode* node = frame.node;
+		if (ptrmap_get(memo, node)) continue;
+
+		// the operands of a chain are its children; inner links are skipped
+		int op = chain_op(node);
+		chain.count = 0;
+		if (op >= 0) {
+			chain_operands(node, op, refs, &chain);
+		} else {
+			for (int i = 0; i < child_count(node); i++) {
+				if (child_at(node, i)) *(const ASTNode**)work_push(&chain) = child_at(node, i);
+			}
+		}
+		const ASTNode** kids = (const ASTNode**)chain.items;
+		int n = chain.count;
+
+		if (!frame.expanded && n > 0) {
+			// come back once the operands are done
+			*(FlattenFrame*)work_push(&stack) = (FlattenFrame){ node, 1 };
+			for (int i = n - 1; i >= 0; i--) {
+				if (!ptrmap_get(memo, kids[i])) *(FlattenFrame*)work_push(&stack) = (FlattenFrame){ kids[i], 0 };
+			}
+			continue;
 		}
 
-		default:
-			return clone_node(node);
+		ASTNode* res;
+		if (op >= 0) {
+			ASTNode** args = malloc(n * sizeof(ASTNode*));
+			if (!args) { perror("malloc"); exit(1); }
+			for (int i = 0; i < n; i++) args[i] = ptrmap_get(memo, kids[i]);
+			res = n == 1 ? args[0] : nary_node(op, args, n);
+			free(args);
+		} else if (n == 0 || node->type == NODE_ASSIGN || node->type == NODE_IF_ELSE || node->type == NODE_WHILE) {
+			res = (ASTNode*)node; // leaves (statements do not occur in formulas)
+		} else {
+			res = rebuild_node(node, memo, 1);
+		}
+		ptrmap_put(memo, node, res);
 	}
-}
 
-// ==================== ASTNode/DLL Deallocation ====================
+	ASTNode* res = ptrmap_get(memo, root);
+	work_free(&chain);
+	work_free(&stack);
+	free_PtrMap(refs);
+	free_PtrMap(memo);
+	return res;
+}
 
-// Recursively frees an ASTNode and all its children
-void free_ASTNode(ASTNode* node) {
-	if (!node || node->freed) return;
+// ==================== Size statistics ====================
 
-	node->freed = 1; // mark as freed to avoid double-free
+// Size (depth == 0: nodes counted at every use) or depth of every node
+// below `root`, bottom-up: a node is measured once its children are. The
+// values are >= 1, so they are stored directly in the value slots of `memo`.
+static unsigned long long measure_tree(const ASTNode* root, int depth, PtrMap* memo) {
+	typedef struct { const ASTNode* node; int expanded; } MeasureFrame;
 
-	switch (node->type) {
-		case NODE_ASSIGN:
-			free(node->Assign.id);
-			free_ASTNode(node->Assign.expr);
-			break;
+	WorkStack stack;
+	work_init(&stack, sizeof(MeasureFrame));
+	*(MeasureFrame*)work_push(&stack) = (MeasureFrame){ root, 0 };
 
-		case NODE_FUNCTION:
-			free(node->function.fname);
-			free_ASTNode(node->function.arg1);
-			free_ASTNode(node->function.arg2);
-			break;
+	MeasureFrame* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		MeasureFrame frame = *top;
+		if (ptrmap_get(memo, frame.node)) continue;
 
-		case NODE_IF_ELSE:
-			free_ASTNode(node->If.condition);
-			free_DLL(node->If.block_if);
-			free_DLL(node->If.block_else);
-			break;
+		int n = child_count(frame.node);
 
-		case NODE_WHILE:
-			free_ASTNode(node->While.condition);
-			free_ASTNode(node->While.invariant);
-			free_ASTNode(node->While.variant);
-			free_DLL(node->While.block_main);
-			break;
+		if (!frame.expanded && n > 0) {
+			*(MeasureFrame*)work_push(&stack) = (MeasureFrame){ frame.node, 1 };
+			for (int i = n - 1; i >= 0; i--) {
+				const ASTNode* kid = child_at(frame.node, i);
+				if (kid && !ptrmap_get(memo, kid)) *(MeasureFrame*)work_push(&stack) = (MeasureFrame){ kid, 0 };
+			}
+			continue;
+		}
 
-		case NODE_BIN_OP:
-			free(node->binary_op.op);
-			free_ASTNode(node->binary_op.left);
-			free_ASTNode(node->binary_op.right);
-			break;
+		unsigned long long v = 0;
+		for (int i = 0; i < n; i++) {
+			const ASTNode* kid = child_at(frame.node, i);
+			if (!kid) continue;
+			unsigned long long k = (unsigned long long)(uintptr_t)ptrmap_get(memo, kid);
+			if (!depth) v += k;
+			else if (k > v) v = k;
+		}
+		ptrmap_put(memo, frame.node, (void*)(uintptr_t)(v + 1));
+	}
 
-		case NODE_UNARY_OP:
-			free(node->unary_op.op);
-			free_ASTNode(node->unary_op.child);
-			break;
+	work_free(&stack);
+	return (unsigned long long)(uintptr_t)ptrmap_get(memo, root);
+}
 
-		case NODE_ID:
-			free(node->id_name);
-			break;
+// Size of a formula seen as a tree (shared subterms counted at every use)
+unsigned long long ast_count_nodes(const ASTNode* node) {
+	if (!node) return 0;
+	PtrMap* memo = create_PtrMap(64);
+	unsigned long long n = measure_tree(node, 0, memo);
+	free_PtrMap(memo);
+	return n;
+}
 
-		case NODE_NUMBER:
-		case NODE_BOOL:
-			break; // no extra memory to free
+// Length of the longest root-to-leaf path of a formula
+unsigned long ast_depth(const ASTNode* node) {
+	if (!node) return 0;
+	PtrMap* memo = create_PtrMap(64);
+	unsigned long d = measure_tree(node, 1, memo);
+	free_PtrMap(memo);
+	return d;
+}
 
-		default:
-			fprintf(stderr, "Warning: freeing unknown ASTNode type %d\n", node->type);
-			break;
+// Number of distinct nodes reachable from a formula (its size as a DAG)
+unsigned long ast_count_distinct(const ASTNode* node) {
+	PtrMap* seen = create_PtrMap(64);
+	WorkStack stack;
+	work_init(&stack, sizeof(const ASTNode*));
+	if (node) *(const ASTNode**)work_push(&stack) = node;
+
+	const ASTNode** top;
+	while ((top = work_pop(&stack)) != NULL) {
+		const ASTNode* n = *top;
+		if (ptrmap_get(seen, n)) continue;
+		ptrmap_put(seen, n, (void*)n);
+
+		for (int i = 0; i < child_count(n); i++) {
+			const ASTNode* kid = child_at(n, i);
+			if (kid) *(const ASTNode**)work_push(&stack) = kid;
+		}
 	}
 
-	free(node);
+	unsigned long n = seen->count;
+	work_free(&stack);
+	free_PtrMap(seen);
+	return n;
 }
 
-// Free a linked list of AST nodes
-void free_ll(line_linkedlist* l) {
-	while (l) {
-		line_linkedlist* next = l->next;
-		free_ASTNode(l->node); // free each AST node
-		free(l);
-		l = next;
-	}
+static int compare_id_nodes(const void* a, const void* b) {
+	return strcmp((*(ASTNode* const*)a)->id_name, (*(ASTNode* const*)b)->id_name);
 }
 
-// Frees a full DLL (pre/post conditions + statements)
-void free_DLL(DLL* dll) {
-	if (!dll) return;
+// Distinct variables of a formula, one ID node per name, sorted by name.
+// The array is allocated in the AST arena; returns its length.
+int ast_collect_ids(const ASTNode* node, ASTNode*** ids) {
+	PtrMap* seen = create_PtrMap(64);
+	WorkStack stack;
+	work_init(&stack, sizeof(const ASTNode*));
+	int count = 0, capacity = 8;
+	ASTNode** out = malloc(capacity * sizeof(ASTNode*));
+	if (!out) { perror("malloc"); exit(1); }
 
-	// Free pre/post conditions if they exist and haven't been freed
-	if (dll->pre && !dll->pre->freed) free_ASTNode(dll->pre);
-	if (dll->post && !dll->post->freed) free_ASTNode(dll->post);
+	if (node) *(const ASTNode**)work_push(&stack) = node;
+	const ASTNode** top;
+	while ((top = work_pop(&stack)) != NULL) {
+		const ASTNode* n = *top;
+		if (ptrmap_get(seen, n)) continue;
+		ptrmap_put(seen, n, (void*)n);
+
+		if (n->type == NODE_ID) {
+			// Interned names are unique per variable, so they serve as keys too
+			if (!ptrmap_get(seen, n->id_name)) {
+				ptrmap_put(seen, n->id_name, n->id_name);
+				if (count == capacity) {
+					capacity *= 2;
+					out = realloc(out, capacity * sizeof(ASTNode*));
+					if (!out) { perror("realloc"); exit(1); }
+				}
+				out[count++] = (ASTNode*)n;
+			}
+			continue;
+		}
 
-	// Free all AST nodes in the DLL linked list
-	line_linkedlist* current = dll->first;
-	while (current) {
-		line_linkedlist* next = current->next;
-		if (current->node && !current->node->freed)
-			free_ASTNode(current->node);
-		free(current);
-		current = next;
+		for (int i = 0; i < child_count(n); i++) {
+			const ASTNode* kid = child_at(n, i);
+			if (kid) *(const ASTNode**)work_push(&stack) = kid;
+		}
 	}
 
-	free(dll); // finally, free the DLL structure itself
-}
\ No newline at end of file
+	qsort(out, count, sizeof(ASTNode*), compare_id_nodes);
+	*ids = ast_alloc((count ? count : 1) * sizeof(ASTNode*));
+	if (count) memcpy(*ids, out, count * sizeof(ASTNode*));
+
+	free(out);
+	work_free(&stack);
+	free_PtrMap(seen);
+	return count;
+}
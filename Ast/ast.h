@@ -1,11 +1,22 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdio.h>
 #include <z3.h>
+#include "arena.h"
+#include "symbol.h"
 
 
 typedef enum { NODE_ASSIGN, NODE_BIN_OP, NODE_IF_ELSE, NODE_WHILE, NODE_NUMBER, 
-					NODE_ID, NODE_FUNCTION, NODE_UNARY_OP, NODE_BOOL} NodeType;
+					NODE_ID, NODE_FUNCTION, NODE_UNARY_OP, NODE_BOOL, NODE_LABEL, NODE_ITE, NODE_NARY} NodeType;
+
+// Operators of NODE_BIN_OP / NODE_UNARY_OP / NODE_NARY (op_to_string maps back to source text)
+typedef enum { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+					OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NEQ,
+					OP_AND, OP_OR, OP_IMPLY, OP_NOT } OpCode;
+
+// Built-in functions of NODE_FUNCTION
+typedef enum { FUNC_MIN, FUNC_MAX, FUNC_FACT } FuncCode;
 
 
 struct DLL_;
@@ -13,16 +24,16 @@ typedef struct DLL_ DLL;
 
 typedef struct ASTNode_ {
 	NodeType type;
-	int freed;
 
 	union {
 		struct {
-			char* id;
+			char* id;				// interned: symbol_name(sym)
+			int sym;
 			struct ASTNode_* expr;
 		} Assign;
 
 		struct {
-			char* fname;
+			FuncCode func;
 			struct ASTNode_* arg1;
 			struct ASTNode_* arg2;
 		} function;
@@ -41,62 +52,145 @@ typedef struct ASTNode_ {
 		} While;
 
 		struct {
-			char *op;
+			OpCode op;
 			struct ASTNode_* left;
 			struct ASTNode_* right;
 		} binary_op;
 
 		struct {
-			char *op;
+			OpCode op;
 			struct ASTNode_*child;
 		} unary_op;
 
+		// Names where a VC part comes from (e.g. a loop's preservation
+		// obligation). Logically transparent: it stands for its child.
+		struct {
+			const char* text;
+			struct ASTNode_* child;
+		} label;
+
+		// ite(c, a, b): a when c holds, b otherwise (an integer term built
+		// by symbolic execution where the branches of an if/else merge)
+		struct {
+			struct ASTNode_* condition;
+			struct ASTNode_* then_term;
+			struct ASTNode_* else_term;
+		} ite;
+
+		// a1 op a2 op ... op an for an associative operator (and, or, +, *):
+		// a flattened chain, built by create_node_nary / flatten_formula.
+		// An operand may itself be an n-ary node of the same operator: a
+		// link shared in the DAG is kept as one (flatten_formula), and
+		// substitution keeps the shape of the nodes it rebuilds. Only
+		// create_node_nary splices such operands in. Consumers must treat
+		// a nested chain like the flat one (split_vc, the cache's shapes).
+		struct {
+			OpCode op;
+			int count;				// >= 2
+			struct ASTNode_** args;	// in the arena
+		} nary;
+
 		int number;
-		char* id_name;
 		int bool_value;
+
+		struct {
+			char* id_name;			// interned: symbol_name(id_sym)
+			int id_sym;
+		};
 	};
 	
 
 } ASTNode;
 
-typedef struct line_linkedlist_ {
-	ASTNode *node;
-	struct line_linkedlist_* next;
-	struct line_linkedlist_* prec;
-} line_linkedlist;
-
+// A block of statements with, for a whole program, its pre/postcondition
+// (NULL for the blocks of if/while). Statements are node handles in one
+// growable array of the arena, walked by index in either direction. (The
+// name is historical: blocks used to be doubly linked lists.)
 typedef struct DLL_ {
-	line_linkedlist* first;
-	line_linkedlist* last;
+	ASTNode** stmts;
+	int count;
+	int capacity;
 	ASTNode *pre;
 	ASTNode *post;
 } DLL;
 
-
-
-ASTNode* create_node_binary(char* type, ASTNode* left, ASTNode* right);
-ASTNode* create_node_unary(char* type, ASTNode* child);
+// Simultaneous substitution [x1 := t1, ..., xn := tn] (open addressing on the symbol)
+typedef struct SubstEnv_ {
+	int* syms;		// 0: empty slot
+	ASTNode** terms;
+	int capacity; // power of two
+	int count;
+} SubstEnv;
+
+
+// Explicit stack of fixed-size frames for the iterative traversals (malloc'd)
+typedef struct WorkStack_ {
+	char* items;
+	size_t item_size;
+	size_t count;
+	size_t capacity;
+} WorkStack;
+
+
+void ast_set_arena(Arena* a);
+Arena* ast_get_arena(void);
+void* ast_alloc(size_t size);
+char* ast_strdup(const char* s);
+void ast_set_sharing(int enabled);
+int ast_sharing(void);
+
+ASTNode* create_node_binary(OpCode op, ASTNode* left, ASTNode* right);
+ASTNode* create_node_unary(OpCode op, ASTNode* child);
 ASTNode* create_node_number(int num);
-ASTNode* create_node_id(char *input);
-ASTNode* create_node_assign(char* id, ASTNode* expr);
+ASTNode* create_node_id(const char* name);
+ASTNode* create_node_symbol(int sym);
+ASTNode* create_node_assign(int sym, ASTNode* expr);
 ASTNode* create_node_If_Else(ASTNode* condition, DLL* block_if, DLL* block_else);
 ASTNode* create_node_While(ASTNode* condition, DLL* block, ASTNode* invariant, ASTNode* variant);
-ASTNode* create_node_Func(const char* name, ASTNode* a1, ASTNode* a2);
+ASTNode* create_node_Func(FuncCode func, ASTNode* a1, ASTNode* a2);
 ASTNode* create_node_bool(int value);
+ASTNode* create_node_label(const char* text, ASTNode* child);
+ASTNode* create_node_ite(ASTNode* condition, ASTNode* then_term, ASTNode* else_term);
+ASTNode* create_node_nary(OpCode op, ASTNode** args, int count);
+int is_associative_op(OpCode op);
+ASTNode* flatten_formula(const ASTNode* node);
 
 DLL* create_DLL();
-line_linkedlist* create_ll(ASTNode* node);
 void DLL_append(DLL* list, ASTNode* node);
+int block_assigned(const DLL* code, int** syms);
+ASTNode* create_node_fresh(int sym, char mark, int k);
+
+const char* op_to_string(OpCode op);
+const char* func_to_string(FuncCode func);
 
 void print_ASTNode(ASTNode* node, int iter, int prof);
-void print_line_linkedlist(line_linkedlist* list, int prof);
+void fprint_formula(FILE* out, const ASTNode* node);
+char* formula_to_string(const ASTNode* node);
 void print_DLL(DLL* dll, int prof, int pre);
 
-ASTNode* substitute(const ASTNode* node, const char* id, const ASTNode* repl);
+ASTNode* substitute(const ASTNode* node, int sym, const ASTNode* repl);
 ASTNode* clone_node(const ASTNode* orig);
 
-void free_ll(line_linkedlist* l);
-void free_DLL(DLL* l);
-void free_ASTNode(ASTNode* node);
+SubstEnv* create_SubstEnv(void);
+ASTNode* subst_env_lookup(const SubstEnv* env, int sym);
+void subst_env_bind(SubstEnv* env, int sym, ASTNode* term);
+ASTNode* substitute_env(const ASTNode* node, const SubstEnv* env);
+SubstEnv* copy_SubstEnv(const SubstEnv* env);
+void free_SubstEnv(SubstEnv* env);
+
+DLL* clone_DLL(const DLL* src);
+
+void work_init(WorkStack* s, size_t item_size);
+void* work_push(WorkStack* s);
+void* work_pop(WorkStack* s);
+void work_free(WorkStack* s);
+int child_count(const ASTNode* node);
+ASTNode** child_slot(ASTNode* node, int i);
+
+unsigned long ast_nodes_allocated(void);
+unsigned long long ast_count_nodes(const ASTNode* node);
+unsigned long ast_count_distinct(const ASTNode* node);
+unsigned long ast_depth(const ASTNode* node);
+int ast_collect_ids(const ASTNode* node, ASTNode*** ids);
 
 #endif
\ No newline at end of file
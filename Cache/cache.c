@@ -0,0 +1,479 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <z3.h>
+
+/* ------------------------------------------------------------------
+	Canonical form of a formula
+	Two obligations get the same canonical text when they differ only by
+	the names of their variables and by the order (and nesting) of the
+	operands of and, or, +, * and the sides of == and !=; e.g.
+		x > 0 and y < x		and		b < a and a > 0
+	both become (and (< v0 v1) (> v1 0)). It is computed in two passes:
+	  1. build a tree where commutative operands are flattened and sorted
+	     by their "shape", i.e. their text with every variable written _
+	     (names cannot be used yet since they are not assigned);
+	  2. print that tree, naming variables v0, v1, ... in order of first
+	     occurrence.
+	Labels are dropped: they do not change the meaning.
+   ------------------------------------------------------------------ */
+
+typedef struct CanonNode_ {
+	const ASTNode* node;
+	char* shape;
+	int nkids;
+	struct CanonNode_** kids;
+} CanonNode;
+
+static int is_commutative(OpCode op) {
+	return op == OP_AND || op == OP_OR || op == OP_ADD || op == OP_MUL
+		|| op == OP_EQ || op == OP_NEQ;
+}
+
+static const ASTNode* skip_labels(const ASTNode* node) {
+	while (node->type == NODE_LABEL) node = node->label.child;
+	return node;
+}
+
+// Collect the operands of a chain of `op` (e.g. a and (b and c) -> a, b, c)
+static void flatten(const ASTNode* node, OpCode op, const ASTNode*** items, int* count, int* cap) {
+	node = skip_labels(node);
+	if (node->type == NODE_BIN_OP && node->binary_op.op == op) {
+		flatten(node->binary_op.left, op, items, count, cap);
+		flatten(node->binary_op.right, op, items, count, cap);
+		return;
+	}
+	if (node->type == NODE_NARY && node->nary.op == op) {
+		for (int i = 0; i < node->nary.count; i++) flatten(node->nary.args[i], op, items, count, cap);
+		return;
+	}
+
+	if (*count == *cap) {
+		*cap *= 2;
+		*items = realloc(*items, *cap * sizeof(ASTNode*));
+		if (!*items) { perror("realloc"); exit(1); }
+	}
+	(*items)[(*count)++] = node;
+}
+
+static int compare_shapes(const void* a, const void* b) {
+	return strcmp((*(CanonNode* const*)a)->shape, (*(CanonNode* const*)b)->shape);
+}
+
+// Head of a node in canonical text: operator, function name or literal
+static void fprint_head(FILE* out, const ASTNode* node) {
+	switch (node->type) {
+		case NODE_BIN_OP:	fputs(op_to_string(node->binary_op.op), out); break;
+		case NODE_NARY:		fputs(op_to_string(node->nary.op), out); break;
+		case NODE_UNARY_OP:	fputs(op_to_string(node->unary_op.op), out); break;
+		case NODE_FUNCTION:	fputs(func_to_string(node->function.func), out); break;
+		case NODE_NUMBER:	fprintf(out, "%d", node->number); break;
+		case NODE_BOOL:		fputs(node->bool_value ? "true" : "false", out); break;
+		case NODE_ITE:		fputs("ite", out); break;
+		default:			fprintf(out, "?%d", node->type); break;
+	}
+}
+
+// Pass 1: sorted tree with name-free shapes (all memory in the AST arena)
+static CanonNode* canon_build(const ASTNode* node) {
+	node = skip_labels(node);
+	CanonNode* c = ast_alloc(sizeof(CanonNode));
+	c->node = node;
+	c->nkids = 0;
+	c->kids = NULL;
+
+	const ASTNode* kids[3];
+	switch (node->type) {
+		case NODE_BIN_OP:
+			if (is_associative_op(node->binary_op.op)) {
+				int cap = 8;
+				const ASTNode** items = malloc(cap * sizeof(ASTNode*));
+				if (!items) { perror("malloc"); exit(1); }
+				flatten(node->binary_op.left, node->binary_op.op, &items, &c->nkids, &cap);
+				flatten(node->binary_op.right, node->binary_op.op, &items, &c->nkids, &cap);
+
+				c->kids = ast_alloc(c->nkids * sizeof(CanonNode*));
+				for (int i = 0; i < c->nkids; i++) c->kids[i] = canon_build(items[i]);
+				free(items);
+			} else {
+				kids[0] = node->binary_op.left;
+				kids[1] = node->binary_op.right;
+				c->nkids = 2;
+			}
+			break;
+		case NODE_NARY: {
+			int cap = node->nary.count * 2;
+			const ASTNode** items = malloc(cap * sizeof(ASTNode*));
+			if (!items) { perror("malloc"); exit(1); }
+			for (int i = 0; i < node->nary.count; i++) flatten(node->nary.args[i], node->nary.op, &items, &c->nkids, &cap);
+
+			c->kids = ast_alloc(c->nkids * sizeof(CanonNode*));
+			for (int i = 0; i < c->nkids; i++) c->kids[i] = canon_build(items[i]);
+			free(items);
+			break;
+		}
+		case NODE_UNARY_OP:
+			kids[0] = node->unary_op.child;
+			c->nkids = 1;
+			break;
+		case NODE_FUNCTION:
+			kids[0] = node->function.arg1;
+			kids[1] = node->function.arg2;
+			c->nkids = node->function.arg2 ? 2 : 1;
+			break;
+		case NODE_ITE:
+			kids[0] = node->ite.condition;
+			kids[1] = node->ite.then_term;
+			kids[2] = node->ite.else_term;
+			c->nkids = 3;
+			break;
+		default:
+			break;
+	}
+
+	if (!c->kids && c->nkids > 0) {
+		c->kids = ast_alloc(c->nkids * sizeof(CanonNode*));
+		for (int i = 0; i < c->nkids; i++) c->kids[i] = canon_build(kids[i]);
+	}
+	if ((node->type == NODE_BIN_OP && is_commutative(node->binary_op.op)) || node->type == NODE_NARY) {
+		qsort(c->kids, c->nkids, sizeof(CanonNode*), compare_shapes);
+	}
+
+	// shape = "(head kid1 kid2 ...)", variables written "_"
+	char* text = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&text, &len);
+	if (!out) { perror("open_memstream"); exit(1); }
+
+	if (node->type == NODE_ID) {
+		fputc('_', out);
+	} else if (c->nkids == 0) {
+		fprint_head(out, node);
+	} else {
+		fputc('(', out);
+		fprint_head(out, node);
+		for (int i = 0; i < c->nkids; i++) fprintf(out, " %s", c->kids[i]->shape);
+		fputc(')', out);
+	}
+	fclose(out);
+
+	c->shape = ast_strdup(text);
+	free(text);
+	return c;
+}
+
+typedef struct {
+	const char** names;
+	int count;
+	int capacity;
+} NameList;
+
+// Pass 2: print with variables numbered by first occurrence
+static void canon_print(FILE* out, const CanonNode* c, NameList* names) {
+	const ASTNode* node = c->node;
+
+	if (node->type == NODE_ID) {
+		int i = 0;
+		while (i < names->count && names->names[i] != node->id_name) i++; // interned
+		if (i == names->count) {
+			if (names->count == names->capacity) {
+				names->capacity *= 2;
+				names->names = realloc(names->names, names->capacity * sizeof(char*));
+				if (!names->names) { perror("realloc"); exit(1); }
+			}
+			names->names[names->count++] = node->id_name;
+		}
+		fprintf(out, "v%d", i);
+		return;
+	}
+
+	if (c->nkids == 0) {
+		fprint_head(out, node);
+		return;
+	}
+
+	fputc('(', out);
+	fprint_head(out, node);
+	for (int i = 0; i < c->nkids; i++) {
+		fputc(' ', out);
+		canon_print(out, c->kids[i], names);
+	}
+	fputc(')', out);
+}
+
+// Canonical text of a formula (in the AST arena). names receives the
+// original variable of each v<i>, also in the arena.
+char* canonical_string(const ASTNode* node, const char*** names, int* nnames) {
+	CanonNode* tree = canon_build(node);
+
+	NameList list = { malloc(8 * sizeof(char*)), 0, 8 };
+	if (!list.names) { perror("malloc"); exit(1); }
+
+	char* text = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&text, &len);
+	if (!out) { perror("open_memstream"); exit(1); }
+	canon_print(out, tree, &list);
+	fclose(out);
+
+	char* result = ast_strdup(text);
+	free(text);
+
+	*nnames = list.count;
+	*names = ast_alloc((list.count ? list.count : 1) * sizeof(char*));
+	if (list.count) memcpy(*names, list.names, list.count * sizeof(char*));
+	free(list.names);
+	return result;
+}
+
+// 64-bit FNV-1a
+uint64_t fnv1a_hash(const char* s) {
+	uint64_t h = 14695981039346656037ULL;
+	for (; *s; s++) {
+		h ^= (unsigned char)*s;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+CacheKey proof_cache_key(const ASTNode* formula) {
+	CacheKey key;
+	char* text = canonical_string(formula, &key.names, &key.nnames);
+	key.hash = fnv1a_hash(text);
+	if (key.hash == 0) key.hash = 1; // 0 is the empty slot of the map
+	return key;
+}
+
+
+/* ------------------------------------------------------------------
+	Cache file
+		hoare-proof-cache <format> z3 <version> <options>
+		<hash> valid
+		<hash> invalid [v<i>=<value> ...]
+	A file whose first line differs from the current one (other Z3
+	version or encoding) is ignored and rewritten on save. Counterexamples
+	are stored over canonical names and renamed back on a hit.
+   ------------------------------------------------------------------ */
+
+typedef struct {
+	Verdict verdict;
+	char* model;		// "v0=1 v2=-3", NULL if none
+} CacheEntry;
+
+static void put_entry(ProofCache* cache, uint64_t hash, Verdict verdict, const char* model) {
+	const void* k = (const void*)(uintptr_t)hash;
+	CacheEntry* e = ptrmap_get(cache->entries, k);
+	if (!e) {
+		e = malloc(sizeof(CacheEntry));
+		if (!e) { perror("malloc"); exit(1); }
+		ptrmap_put(cache->entries, k, e);
+	} else {
+		free(e->model);
+	}
+	e->verdict = verdict;
+	e->model = model ? strdup(model) : NULL;
+}
+
+ProofCache* load_ProofCache(const char* path) {
+	ProofCache* cache = malloc(sizeof(ProofCache));
+	if (!cache) { perror("malloc"); exit(1); }
+
+	cache->path = strdup(path);
+	cache->entries = create_PtrMap(256);
+	cache->hits = cache->misses = 0;
+	cache->dirty = 0;
+	pthread_mutex_init(&cache->lock, NULL);
+
+	unsigned major, minor, build, revision;
+	Z3_get_version(&major, &minor, &build, &revision);
+	snprintf(cache->header, sizeof(cache->header), "hoare-proof-cache %d z3 %u.%u.%u.%u %s",
+		PROOF_CACHE_FORMAT, major, minor, build, revision, PROOF_CACHE_OPTIONS);
+
+	FILE* in = fopen(path, "r");
+	if (!in) return cache; // a new cache
+
+	char* line = NULL;
+	size_t cap = 0;
+	ssize_t n = getline(&line, &cap, in);
+	if (n > 0 && line[n - 1] == '\n') line[--n] = '\0';
+
+	if (n < 0 || strcmp(line, cache->header) != 0) {
+		fprintf(stderr, "%s: other format or Z3 version, starting a new cache\n", path);
+		cache->dirty = 1;
+	} else {
+		while ((n = getline(&line, &cap, in)) > 0) {
+			if (line[n - 1] == '\n') line[--n] = '\0';
+
+			unsigned long long hash;
+			char verdict[16];
+			int used = 0;
+			if (sscanf(line, "%llx %15s %n", &hash, verdict, &used) < 2) continue;
+
+			if (strcmp(verdict, "valid") == 0) {
+				put_entry(cache, hash, VERDICT_VALID, NULL);
+			} else if (strcmp(verdict, "invalid") == 0) {
+				put_entry(cache, hash, VERDICT_INVALID, line[used] ? line + used : NULL);
+			}
+		}
+	}
+
+	free(line);
+	fclose(in);
+	return cache;
+}
+
+// "x = 1, y = -3" over names -> "v1=1 v0=-3" (NULL if a name is unknown)
+static char* model_to_canonical(const char* model, const CacheKey* key) {
+	char* copy = strdup(model);
+	char* text = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&text, &len);
+	if (!copy || !out) { perror("malloc"); exit(1); }
+
+	int ok = 1, first = 1;
+	char* save = NULL;
+	for (char* part = strtok_r(copy, ",", &save); part && ok; part = strtok_r(NULL, ",", &save)) {
+		char name[256], value[256];
+		if (sscanf(part, " %255s = %255s", name, value) != 2) { ok = 0; break; }
+
+		int i = 0;
+		while (i < key->nnames && strcmp(key->names[i], name) != 0) i++;
+		if (i == key->nnames) { ok = 0; break; }
+
+		fprintf(out, "%sv%d=%s", first ? "" : " ", i, value);
+		first = 0;
+	}
+	fclose(out);
+	free(copy);
+
+	if (!ok) { free(text); return NULL; }
+	return text;
+}
+
+static int compare_names(const void* a, const void* b) {
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Inverse of model_to_canonical, sorted by name like the solver's models
+static char* model_from_canonical(const char* model, const CacheKey* key) {
+	int count = 0;
+	char** parts = malloc((key->nnames ? key->nnames : 1) * sizeof(char*));
+	char* copy = strdup(model);
+	if (!parts || !copy) { perror("malloc"); exit(1); }
+
+	char* save = NULL;
+	for (char* part = strtok_r(copy, " ", &save); part; part = strtok_r(NULL, " ", &save)) {
+		int i;
+		char value[256];
+		if (sscanf(part, "v%d=%255s", &i, value) != 2 || i < 0 || i >= key->nnames || count == key->nnames) continue;
+
+		size_t len = strlen(key->names[i]) + strlen(value) + 4;
+		parts[count] = malloc(len);
+		if (!parts[count]) { perror("malloc"); exit(1); }
+		snprintf(parts[count++], len, "%s = %s", key->names[i], value);
+	}
+	qsort(parts, count, sizeof(char*), compare_names);
+
+	char* text = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&text, &len);
+	if (!out) { perror("open_memstream"); exit(1); }
+	for (int i = 0; i < count; i++) {
+		fprintf(out, "%s%s", i ? ", " : "", parts[i]);
+		free(parts[i]);
+	}
+	fclose(out);
+
+	free(parts);
+	free(copy);
+	return text;
+}
+
+// Fill `result` from the cache; returns 1 on a hit
+int proof_cache_lookup(ProofCache* cache, const CacheKey* key, ObligationResult* result) {
+	pthread_mutex_lock(&cache->lock);
+	CacheEntry* e = ptrmap_get(cache->entries, (const void*)(uintptr_t)key->hash);
+	if (e) {
+		cache->hits++;
+		result->verdict = e->verdict;
+		result->model = NULL;
+		if (e->verdict == VERDICT_INVALID) {
+			result->model = e->model ? model_from_canonical(e->model, key) : strdup("");
+		}
+	} else {
+		cache->misses++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return e != NULL;
+}
+
+// Remember a definitive verdict (unknown and error results are not cached)
+void proof_cache_store(ProofCache* cache, const CacheKey* key, const ObligationResult* result) {
+	if (result->verdict != VERDICT_VALID && result->verdict != VERDICT_INVALID) return;
+
+	char* model = result->model ? model_to_canonical(result->model, key) : NULL;
+	if (result->model && !model) return; // counterexample not representable
+
+	pthread_mutex_lock(&cache->lock);
+	put_entry(cache, key->hash, result->verdict, model);
+	cache->dirty = 1;
+	pthread_mutex_unlock(&cache->lock);
+
+	free(model);
+}
+
+// Write the cache back (to a temporary file renamed over the old one)
+int save_ProofCache(ProofCache* cache) {
+	if (!cache->dirty) return 0;
+
+	size_t len = strlen(cache->path) + 5;
+	char* tmp = malloc(len);
+	if (!tmp) { perror("malloc"); exit(1); }
+	snprintf(tmp, len, "%s.tmp", cache->path);
+
+	FILE* out = fopen(tmp, "w");
+	if (!out) {
+		perror(tmp);
+		free(tmp);
+		return -1;
+	}
+
+	fprintf(out, "%s\n", cache->header);
+	for (size_t i = 0; i < cache->entries->capacity; i++) {
+		PtrEntry* slot = &cache->entries->entries[i];
+		if (!slot->key) continue;
+
+		CacheEntry* e = slot->value;
+		fprintf(out, "%016llx %s", (unsigned long long)(uintptr_t)slot->key,
+			e->verdict == VERDICT_VALID ? "valid" : "invalid");
+		if (e->model && e->model[0]) fprintf(out, " %s", e->model);
+		fputc('\n', out);
+	}
+
+	int status = 0;
+	if (fclose(out) != 0 || rename(tmp, cache->path) != 0) {
+		perror(cache->path);
+		status = -1;
+	}
+	free(tmp);
+	cache->dirty = 0;
+	return status;
+}
+
+void free_ProofCache(ProofCache* cache) {
+	if (!cache) return;
+
+	for (size_t i = 0; i < cache->entries->capacity; i++) {
+		PtrEntry* slot = &cache->entries->entries[i];
+		if (!slot->key) continue;
+
+		CacheEntry* e = slot->value;
+		free(e->model);
+		free(e);
+	}
+	free_PtrMap(cache->entries);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->path);
+	free(cache);
+}
@@ -0,0 +1,47 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "ast.h"
+#include "hashmap.h"
+#include "solver.h"
+
+// Bump when the meaning of a cached verdict changes (Z3 encoding of the
+// AST, integer semantics, ...): older cache files are then ignored.
+#define PROOF_CACHE_FORMAT 1
+#define PROOF_CACHE_OPTIONS "ints=unbounded"
+
+// Identity of an obligation up to variable renaming and the order of
+// and/or/+/* operands. names[i] is the program variable written v<i>.
+typedef struct CacheKey_ {
+	uint64_t hash;			// FNV-1a of the canonical text
+	const char** names;		// in the AST arena
+	int nnames;
+} CacheKey;
+
+// Definitive verdicts (valid / invalid with its counterexample) of
+// obligations seen before, loaded from and saved to one file. Shared by
+// all verifier threads of a run.
+typedef struct ProofCache_ {
+	char* path;
+	PtrMap* entries;		// hash -> CacheEntry*
+	char header[128];		// format, Z3 version and options
+	unsigned long hits;
+	unsigned long misses;
+	int dirty;
+	pthread_mutex_t lock;
+} ProofCache;
+
+
+char* canonical_string(const ASTNode* node, const char*** names, int* nnames);
+uint64_t fnv1a_hash(const char* s);
+CacheKey proof_cache_key(const ASTNode* formula);
+
+ProofCache* load_ProofCache(const char* path);
+int proof_cache_lookup(ProofCache* cache, const CacheKey* key, ObligationResult* result);
+void proof_cache_store(ProofCache* cache, const CacheKey* key, const ObligationResult* result);
+int save_ProofCache(ProofCache* cache);
+void free_ProofCache(ProofCache* cache);
+
+#endif
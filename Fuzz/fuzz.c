@@ -0,0 +1,208 @@
+#include "fuzz.h"
+#include "interp.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------
+	Property fuzzing of the annotations
+	The program is compiled once (Interp/interp.c) and run by `threads`
+	workers on random input states until the time budget is spent.
+	Each worker has its own slots, stack and random stream; the code
+	is shared read-only. A run stops on the first check that fails
+	(invariant on entry or after an iteration, variant, postcondition);
+	for each check the worker keeps the smallest input that broke it,
+	by the sum of the absolute values of the inputs.
+	After the workers are joined, each of these inputs is shrunk: every
+	input is moved towards 0 while the same check still fails.
+   ------------------------------------------------------------------ */
+
+#define FUZZ_STEPS		100000		// loop iterations per run
+
+typedef struct {
+	const Bytecode* bc;
+	double deadline;
+	unsigned long long seed;
+	unsigned long long states, runs, inconclusive;
+	unsigned long long* failures;		// per check
+	unsigned long long* smallest_size;	// per check (ULLONG_MAX: none yet)
+	long long* smallest;				// per check, nvars inputs
+} FuzzWorker;
+
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static unsigned long long input_size(const Bytecode* bc, const long long* inputs) {
+	unsigned long long size = 0;
+	for (int x = 0; x < bc->nvars; x++) {
+		if (bc->input[x]) size += inputs[x] < 0 ? -(unsigned long long)inputs[x] : (unsigned long long)inputs[x];
+	}
+	return size;
+}
+
+static void* fuzz_worker(void* arg) {
+	FuzzWorker* w = arg;
+	const Bytecode* bc = w->bc;
+
+	long long* slots = malloc((bc->nslots ? bc->nslots : 1) * sizeof(long long));
+	long long* stack = malloc((bc->max_stack ? bc->max_stack : 1) * sizeof(long long));
+	long long* inputs = malloc((bc->nvars ? bc->nvars : 1) * sizeof(long long));
+	if (!slots || !stack || !inputs) { perror("malloc"); exit(1); }
+
+	unsigned long long state = w->seed;
+	for (;;) {
+		// Reading the clock costs more than a short run
+		if ((w->states & 255) == 0 && now_ms() >= w->deadline) break;
+
+		random_inputs(bc, slots, &state);
+		memcpy(inputs, slots, bc->nvars * sizeof(long long));
+		w->states++;
+
+		int failed;
+		RunStatus status = run_Bytecode(bc, slots, stack, FUZZ_STEPS, &failed);
+		if (status == RUN_PRE_FALSE) continue;
+
+		w->runs++;
+		if (status == RUN_UNDEFINED || status == RUN_OUT_OF_STEPS) w->inconclusive++;
+		if (status != RUN_FAILED) continue;
+
+		w->failures[failed]++;
+		unsigned long long size = input_size(bc, inputs);
+		if (size < w->smallest_size[failed]) {
+			w->smallest_size[failed] = size;
+			memcpy(w->smallest + (size_t)failed * bc->nvars, inputs, bc->nvars * sizeof(long long));
+		}
+	}
+
+	free(slots);
+	free(stack);
+	free(inputs);
+	return NULL;
+}
+
+// Does the run from `inputs` stop on `check`?
+static int fails_check(const Bytecode* bc, const long long* inputs, int check, long long* slots, long long* stack) {
+	memset(slots, 0, bc->nslots * sizeof(long long));
+	memcpy(slots, inputs, bc->nvars * sizeof(long long));
+
+	int failed;
+	return run_Bytecode(bc, slots, stack, FUZZ_STEPS, &failed) == RUN_FAILED && failed == check;
+}
+
+// Move each input towards 0 while `check` keeps failing (the sum of
+// absolute values decreases at every step, so this ends)
+static void shrink(const Bytecode* bc, long long* inputs, int check) {
+	long long* slots = malloc((bc->nslots ? bc->nslots : 1) * sizeof(long long));
+	long long* stack = malloc((bc->max_stack ? bc->max_stack : 1) * sizeof(long long));
+	if (!slots || !stack) { perror("malloc"); exit(1); }
+
+	int progress = 1;
+	while (progress) {
+		progress = 0;
+		for (int x = 0; x < bc->nvars; x++) {
+			if (!bc->input[x] || bc->pinned[x]) continue;
+
+			long long v = inputs[x];
+			long long candidates[3] = { 0, v / 2, v > 0 ? v - 1 : v + 1 };
+			for (int k = 0; k < 3 && v != 0; k++) {
+				long long c = candidates[k];
+				if (c == v || (c < 0 ? -c : c) >= (v < 0 ? -v : v)) continue;
+
+				inputs[x] = c;
+				if (fails_check(bc, inputs, check, slots, stack)) { progress = 1; break; }
+				inputs[x] = v;
+			}
+		}
+	}
+
+	free(slots);
+	free(stack);
+}
+
+// Fuzz `program` for `seconds` on `threads` threads. Labels and inputs
+// in the report are allocated from the AST arena of the calling thread.
+void fuzz_program(DLL* program, int threads, double seconds, FuzzReport* report) {
+	memset(report, 0, sizeof(FuzzReport));
+	if (threads < 1) threads = 1;
+
+	Bytecode* bc = compile_program(program);
+	size_t nchecks = bc->nchecks ? bc->nchecks : 1;
+	size_t nvars = bc->nvars ? bc->nvars : 1;
+
+	FuzzWorker* workers = calloc(threads, sizeof(FuzzWorker));
+	pthread_t* ids = malloc(threads * sizeof(pthread_t));
+	if (!workers || !ids) { perror("malloc"); exit(1); }
+
+	double start = now_ms();
+	for (int i = 0; i < threads; i++) {
+		FuzzWorker* w = &workers[i];
+		w->bc = bc;
+		w->deadline = start + seconds * 1e3;
+		w->seed = 0x9E3779B97F4A7C15ULL * (unsigned long long)(i + 1);
+		w->failures = calloc(nchecks, sizeof(unsigned long long));
+		w->smallest_size = malloc(nchecks * sizeof(unsigned long long));
+		w->smallest = malloc(nchecks * nvars * sizeof(long long));
+		if (!w->failures || !w->smallest_size || !w->smallest) { perror("malloc"); exit(1); }
+		for (size_t c = 0; c < nchecks; c++) w->smallest_size[c] = ULLONG_MAX;
+
+		if (pthread_create(&ids[i], NULL, fuzz_worker, w) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < threads; i++) {
+		pthread_join(ids[i], NULL);
+	}
+	report->seconds = (now_ms() - start) / 1e3;
+	report->threads = threads;
+
+	// Merge the workers: counts add up, the smallest input wins
+	report->failures = malloc(nchecks * sizeof(FuzzFailure));
+	if (!report->failures) { perror("malloc"); exit(1); }
+
+	for (int i = 0; i < threads; i++) {
+		report->states += workers[i].states;
+		report->runs += workers[i].runs;
+		report->inconclusive += workers[i].inconclusive;
+	}
+	for (int c = 0; c < bc->nchecks; c++) {
+		FuzzWorker* best = NULL;
+		unsigned long long failures = 0;
+		for (int i = 0; i < threads; i++) {
+			failures += workers[i].failures[c];
+			if (workers[i].failures[c] && (!best || workers[i].smallest_size[c] < best->smallest_size[c])) {
+				best = &workers[i];
+			}
+		}
+		if (!best) continue;
+
+		long long* inputs = best->smallest + (size_t)c * bc->nvars;
+		shrink(bc, inputs, c);
+
+		FuzzFailure* f = &report->failures[report->nfailures++];
+		f->label = bc->checks[c];
+		f->failures = failures;
+		f->inputs = inputs_to_string(bc, inputs);
+	}
+
+	for (int i = 0; i < threads; i++) {
+		free(workers[i].failures);
+		free(workers[i].smallest_size);
+		free(workers[i].smallest);
+	}
+	free(workers);
+	free(ids);
+	free_Bytecode(bc);
+}
+
+void free_FuzzReport(FuzzReport* report) {
+	free(report->failures);
+	memset(report, 0, sizeof(FuzzReport));
+}
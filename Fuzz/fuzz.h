@@ -0,0 +1,26 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "ast.h"
+
+// A check that failed during fuzzing
+typedef struct {
+	const char* label;					// e.g. "while (i < n): invariant preserved"
+	unsigned long long failures;		// runs that stopped on it
+	const char* inputs;					// smallest failing input, "n = 2" (arena string)
+} FuzzFailure;
+
+typedef struct {
+	int threads;
+	double seconds;						// wall time spent running
+	unsigned long long states;			// input states tried
+	unsigned long long runs;			// ... that satisfy the precondition
+	unsigned long long inconclusive;	// ... and were given up (overflow, steps)
+	FuzzFailure* failures;				// in program order (malloc'd)
+	int nfailures;
+} FuzzReport;
+
+void fuzz_program(DLL* program, int threads, double seconds, FuzzReport* report);
+void free_FuzzReport(FuzzReport* report);
+
+#endif
@@ -1,85 +1,106 @@
 #include "hashmap.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
-HashMap* create_HashMap(int size) {
-	HashMap* res = malloc(sizeof(HashMap));
+// ==================== Pointer-keyed map ====================
 
-	if (!res) return NULL;
-	res->size = size;
-	res->table = malloc(sizeof(HashEntry*) * size);
-	
-	if (!res->table) {
-		free(res);
-		return NULL;
-	}
-
-	for(int i = 0; i < size; i++) {
-		res->table[i] = NULL;
-	}
-
-	return res;
+static size_t ptr_hash(const void* p) {
+	uint64_t x = (uint64_t)(uintptr_t)p;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL; // 64-bit finalizer (murmur3 fmix)
+	x ^= x >> 33;
+	return (size_t)x;
 }
 
-unsigned long hash_djb2(const char* str) {
-	unsigned long hash = 5381;
-	int c;
+PtrMap* create_PtrMap(size_t capacity) {
+	PtrMap* m = malloc(sizeof(PtrMap));
+	if (!m) { perror("malloc"); exit(1); }
 
-	while ((c = *str++))
-		hash = ((hash << 5) + hash) + c; 
+	size_t cap = 16;
+	while (cap < capacity) cap <<= 1;
 
-	return hash;
+	m->capacity = cap;
+	m->count = 0;
+	m->entries = calloc(cap, sizeof(PtrEntry));
+	if (!m->entries) { perror("calloc"); exit(1); }
+	return m;
 }
 
-int hash(HashMap* h,const char* str) {
-	return (int) (hash_djb2(str) % h->size);
+// Value stored for key, NULL if absent
+void* ptrmap_get(const PtrMap* m, const void* key) {
+	size_t mask = m->capacity - 1;
+	size_t i = ptr_hash(key) & mask;
+
+	while (m->entries[i].key) {
+		if (m->entries[i].key == key) return m->entries[i].value;
+		i = (i + 1) & mask;
+	}
+	return NULL;
 }
 
-HashEntry* create_HashEntry(const char* key, Z3_ast node) {
-	HashEntry* res = malloc(sizeof(HashEntry));
-	res->key = strdup(key);
-	res->value = node;
-	res->next = NULL;
-	return res;
+// Double the table once it is 3/4 full
+static void ptrmap_grow(PtrMap* m) {
+	PtrEntry* old = m->entries;
+	size_t old_cap = m->capacity;
+
+	m->capacity = old_cap * 2;
+	m->entries = calloc(m->capacity, sizeof(PtrEntry));
+	if (!m->entries) { perror("calloc"); exit(1); }
+	m->count = 0;
+
+	for (size_t i = 0; i < old_cap; i++) {
+		if (old[i].key) ptrmap_put(m, old[i].key, old[i].value);
+	}
+	free(old);
 }
 
-void insert_HashMap(HashMap* h, const char* name, Z3_ast node) {
-	int index = hash(h, name);
+// Insert or update key -> value (key must not be NULL)
+void ptrmap_put(PtrMap* m, const void* key, void* value) {
+	if ((m->count + 1) * 4 > m->capacity * 3) ptrmap_grow(m);
 
-	// Check if key already exists
-	HashEntry* tmp = h->table[index];
-	while (tmp != NULL) {
-		if (strcmp(tmp->key, name) == 0) {
-			tmp->value = node;  // Update existing entry
+	size_t mask = m->capacity - 1;
+	size_t i = ptr_hash(key) & mask;
+
+	while (m->entries[i].key) {
+		if (m->entries[i].key == key) {
+			m->entries[i].value = value;
 			return;
 		}
-		tmp = tmp->next;
+		i = (i + 1) & mask;
 	}
+	m->entries[i].key = key;
+	m->entries[i].value = value;
+	m->count++;
+}
+
+// Remove all entries, keeping the allocated table
+void ptrmap_clear(PtrMap* m) {
+	memset(m->entries, 0, m->capacity * sizeof(PtrEntry));
+	m->count = 0;
+}
 
-	// Key doesn't exist, create new entry
-	HashEntry* n = create_HashEntry(name, node);
-	n->next = h->table[index];  // Insert at beginning of chain
-	h->table[index] = n;
+void free_PtrMap(PtrMap* m) {
+	if (!m) return;
+	free(m->entries);
+	free(m);
 }
 
-void free_hashmap_with_context(HashMap* map, Z3_context ctx) {
-	if (!map) return;
-
-	for (int i = 0; i < map->size; i++) {
-		HashEntry* entry = map->table[i];
-		while (entry) {
-			HashEntry* next = entry->next;
-			
-			// Decrement Z3 reference for the value
-			if (entry->value && ctx) {
-				Z3_dec_ref(ctx, (Z3_ast)entry->value);
-			}
-			
-			free(entry->key);
-			free(entry);
-			entry = next;
+// Drop all entries of a map whose values are referenced Z3_ast terms
+void clear_ptrmap_with_context(PtrMap* m, Z3_context ctx) {
+	if (!m) return;
+
+	for (size_t i = 0; i < m->capacity; i++) {
+		if (m->entries[i].key && m->entries[i].value && ctx) {
+			Z3_dec_ref(ctx, (Z3_ast)m->entries[i].value);
 		}
 	}
-	free(map->table);
-	free(map);
-}
\ No newline at end of file
+	ptrmap_clear(m);
+}
+
+// Free a map whose values are referenced Z3_ast terms
+void free_ptrmap_with_context(PtrMap* m, Z3_context ctx) {
+	clear_ptrmap_with_context(m, ctx);
+	free_PtrMap(m);
+}
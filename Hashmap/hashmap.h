@@ -3,22 +3,25 @@
 
 #include <z3.h>
 
-typedef struct HashEntry_ {
-	char *key;
-	Z3_ast value;
-	struct HashEntry_* next;
-} HashEntry;
+// Open-addressing map keyed by pointer identity (e.g. ASTNode* -> result)
+typedef struct PtrEntry_ {
+	const void* key;
+	void* value;
+} PtrEntry;
 
-typedef struct HashMap_ {
-	int size;
-	HashEntry** table;
-} HashMap;
+typedef struct PtrMap_ {
+	size_t capacity; // power of two
+	size_t count;
+	PtrEntry* entries;
+} PtrMap;
 
 
-HashMap* create_HashMap(int size);
-int hash(HashMap* h,const char* str);
-HashEntry* create_HashEntry(const char* key, Z3_ast node);
-void insert_HashMap(HashMap* h, const char* name, Z3_ast node);
-void free_hashmap_with_context(HashMap* hm, Z3_context ctx);
+PtrMap* create_PtrMap(size_t capacity);
+void* ptrmap_get(const PtrMap* m, const void* key);
+void ptrmap_put(PtrMap* m, const void* key, void* value);
+void ptrmap_clear(PtrMap* m);
+void free_PtrMap(PtrMap* m);
+void clear_ptrmap_with_context(PtrMap* m, Z3_context ctx);
+void free_ptrmap_with_context(PtrMap* m, Z3_context ctx);
 
 #endif
\ No newline at end of file
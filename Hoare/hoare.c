@@ -1,4 +1,6 @@
 #include "hoare.h"
+#include "symexec.h"
+#include <stdlib.h>
 #include <string.h>
 
 // factorial used by evaluate_expr()
@@ -16,24 +18,75 @@ int is_node_true(ASTNode* node) {
 }
 
 
-// Backward Hoare prover: compute precondition for whole DLL.
-ASTNode* hoare_prover(DLL* code, ASTNode* pre, ASTNode* post) {
+// Label text "<keyword> (<condition>): <what>" for an obligation of a rule
+const char* rule_label(const char* keyword, ASTNode* condition, const char* what) {
+	char* cond = formula_to_string(condition);
+	size_t len = strlen(keyword) + strlen(cond) + strlen(what) + 6;
+	char* text = ast_alloc(len);
+	snprintf(text, len, "%s (%s): %s", keyword, cond, what);
+	return text;
+}
+
+
+// Fresh names x@k of hoare_WhileRule, numbered per VC: the outermost
+// hoare_prover or hoare_WhileRule call restarts the count, the calls it
+// makes continue it (so the names do not depend on which thread, or
+// which earlier file, came first)
+static _Thread_local int loop_fresh = 0;
+static _Thread_local int rule_depth = 0;
+
+// Backward Hoare prover: compute precondition for a whole block.
+ASTNode* hoare_prover(DLL* code, ASTNode* post) {
 
 	if (!code || !post) {
 		fprintf(stderr, RED "NULL input to hoare_prover\n" RESET);
 		return NULL;
 	}
+	if (rule_depth++ == 0) loop_fresh = 0;
 
-	line_linkedlist *current = code->last;
+	int current = code->count - 1;
 	ASTNode* wp = clone_node(post); 
 
-	while( current != NULL ) {
-		ASTNode* new_wp = hoare_statement(current->node, wp);
-		free_ASTNode(wp); 
-		wp = new_wp;
-		current = current->prec;
+	// Intermediate wps stay in the AST arena until the job resets it
+	while( current >= 0 ) {
+		if (code->stmts[current]->type == NODE_ASSIGN) {
+			// A straight-line run of assignments is handled in one substitution
+			int first = current;
+			while (first > 0 && code->stmts[first - 1]->type == NODE_ASSIGN) first--;
+
+			wp = hoare_AssignmentBlock(code->stmts + first, current - first + 1, wp);
+			current = first - 1;
+			continue;
+		}
+
+		wp = hoare_statement(code->stmts[current], wp);
+		current--;
 	}
 
+	rule_depth--;
+	return wp;
+}
+
+
+/* ------------------------------------------------------------------
+	Straight-line block of assignments x1 := E1; ...; xn := En
+	Instead of applying the assignment axiom n times backwards (each step
+	copying the whole postcondition), we run the block forwards once and
+	accumulate a simultaneous substitution over the block's entry state:
+		env(xi) := Ei[env]		(Ei evaluated in the current state)
+	then wp = post[env] in a single traversal of post.
+	The run is the `count` assignments starting at `assigns`.
+   ------------------------------------------------------------------ */
+ASTNode* hoare_AssignmentBlock(ASTNode** assigns, int count, ASTNode* post) {
+	SubstEnv* env = create_SubstEnv();
+
+	for (int i = 0; i < count; i++) {
+		ASTNode* assign = assigns[i];
+		subst_env_bind(env, assign->Assign.sym, substitute_env(assign->Assign.expr, env));
+	}
+
+	ASTNode* wp = substitute_env(post, env);
+	free_SubstEnv(env);
 	return wp;
 }
 
@@ -59,7 +112,7 @@ ASTNode* hoare_statement(ASTNode* node, ASTNode* post) {
 	Implementation:
 		- compute a substitution of the postcondition: replace occurrences
 		of the assigned id with the right-hand expression.
-		- return the substituted AST (fresh allocation).
+		- return the substituted AST (fresh allocation in the AST arena).
 	 ------------------------------------------------------------------ */
 ASTNode* hoare_AssignmentRule(ASTNode* node, ASTNode* post ) {
 	if (!node || node->type != NODE_ASSIGN) {
@@ -67,10 +120,7 @@ ASTNode* hoare_AssignmentRule(ASTNode* node, ASTNode* post ) {
 		return NULL;
 	}
 
-	ASTNode* post_clone = clone_node(post);
-	ASTNode* result = substitute(post_clone, node->Assign.id, node->Assign.expr);
-	free_ASTNode(post_clone); // free the clone, safe
-	return result;
+	return substitute(post, node->Assign.sym, node->Assign.expr);
 }
 
 
@@ -82,9 +132,10 @@ ASTNode* hoare_AssignmentRule(ASTNode* node, ASTNode* post ) {
 		then { P } if B then S else T { Q }
 
 	Implementation:
-		- Compute wp_if = hoare_prover(block_if, NULL, clone(post)).
-		- Compute wp_else = hoare_prover(block_else, NULL, clone(post)) or clone(post) if no else block.
-		- Return (B -> wp_if) ∧ (¬B -> wp_else).
+		- Compute wp_if = hoare_prover(block_if, post).
+		- Compute wp_else = hoare_prover(block_else, post).
+		- Return (B -> wp_if) ∧ (¬B -> wp_else), each side labeled with
+		  the branch it comes from.
    ------------------------------------------------------------------ */
 ASTNode* hoare_IfElseRule(ASTNode* node_IfElse, ASTNode* post) {
 
@@ -103,17 +154,10 @@ ASTNode* hoare_IfElseRule(ASTNode* node_IfElse, ASTNode* post) {
 		return NULL;
 	}
 
-	/* For each branch we pass a clone of post to hoare_prover so the branch
-		computation is independent and returns a fresh AST. */
-	ASTNode* post_clone_if = clone_node(post);
-	ASTNode* post_clone_else = clone_node(post);
-
-	ASTNode* wp_if = hoare_prover(block_if, NULL, post_clone_if);
-	ASTNode* wp_else = hoare_prover(block_else, NULL, post_clone_else);
-
-	// Free the cloned post conditions since they're consumed by hoare_prover
-	free_ASTNode(post_clone_if);
-	free_ASTNode(post_clone_else);
+	/* hoare_prover clones post itself, so each branch computation is
+		independent and returns a fresh AST. */
+	ASTNode* wp_if = hoare_prover(block_if, post);
+	ASTNode* wp_else = hoare_prover(block_else, post);
 
 	// Build implication nodes
 	ASTNode* condition_clone = clone_node(condition);
@@ -121,14 +165,16 @@ ASTNode* hoare_IfElseRule(ASTNode* node_IfElse, ASTNode* post) {
 	
 	
 	/* Build (B -> pre_if) */
-	ASTNode* left = create_node_binary("->", condition_clone, wp_if);
+	ASTNode* left = create_node_binary(OP_IMPLY, condition_clone, wp_if);
 	
 	 /* Build (¬B -> pre_else) */
-	ASTNode* not_condition = create_node_unary("not", condition_not_clone);
-	ASTNode* right = create_node_binary("->", not_condition, wp_else);
+	ASTNode* not_condition = create_node_unary(OP_NOT, condition_not_clone);
+	ASTNode* right = create_node_binary(OP_IMPLY, not_condition, wp_else);
 
 	/* Return (B -> pre_if) ∧ (¬B -> pre_else) */
-	ASTNode* result = create_node_binary("and", left, right);
+	ASTNode* result = create_node_binary(OP_AND,
+		create_node_label(rule_label("if", condition, "then-branch"), left),
+		create_node_label(rule_label("if", condition, "else-branch"), right));
 	return result;
 }
 
@@ -147,94 +193,105 @@ ASTNode* hoare_IfElseRule(ASTNode* node_IfElse, ASTNode* post) {
 
 		Concretely we encode:
 			(I ∧ B) -> (variant_after < variant ∧ variant >= 0)
+
+	The loop runs any number of times, so preservation, exit and the
+	variant are checked in an arbitrary state where I holds: every
+	variable the body assigns (inner loops included) is replaced by a
+	fresh name x@k in them. Only the invariant itself is checked in the
+	state before the loop:
+		I ∧ ((I ∧ B -> wp(S, I)) ∧ (I ∧ ¬B -> post) ∧ ...)[x := x@k]
+
+	Each of the five obligations (entry, preservation, exit, decrease,
+	non-negativity) is labeled so a failure can be traced back to it.
    ------------------------------------------------------------------ */
 ASTNode* hoare_WhileRule(ASTNode* node, ASTNode* post) {
+	if (rule_depth++ == 0) loop_fresh = 0;
 	
 	ASTNode* condition = node->While.condition; // B
 	ASTNode* invariant = node->While.invariant; // I (loop invariant)
 	ASTNode* variant = node->While.variant;		// t (termination measure)
 	DLL* block_code = node->While.block_main;	// S (loop body)
 
-	// Create I ∧ B for the loop body precondition
-	ASTNode* I_clone_1 = clone_node(invariant);
-	ASTNode* condition_clone_1 = clone_node(condition);
-	ASTNode* I_and_B = create_node_binary("and", I_clone_1, condition_clone_1);
-
-	
-	// Get weakest precondition for the loop body
-	ASTNode* invariant_clone_for_wp = clone_node(invariant);
-	ASTNode* wp_body = hoare_prover(block_code, I_and_B, invariant_clone_for_wp);
-	
-	
-	// Free the consumed arguments
-	free_ASTNode(I_and_B);
-	free_ASTNode(invariant_clone_for_wp);
+	// State after one iteration, every variable as a term over the state
+	// before it (branches become ite). Without inner loops the body's wp
+	// is just I in that state; inner loops bring obligations of their
+	// own, so then the body goes through hoare_prover.
+	SymState after = symexec_block(block_code);
+	ASTNode* wp_body = after.assumption
+		? hoare_prover(block_code, invariant)
+		: substitute_env(invariant, after.env);
 
 
 	// Build (I ∧ ¬B) -> post
 	//   This encodes: when loop exits, invariant + ¬B imply the outer postcondition.
 	ASTNode* I_clone_2 = clone_node(invariant);
 	ASTNode* condition_clone_2 = clone_node(condition);
-	ASTNode* not_condition = create_node_unary("not", condition_clone_2);
-	ASTNode* I_and_notB = create_node_binary("and", I_clone_2, not_condition);
+	ASTNode* not_condition = create_node_unary(OP_NOT, condition_clone_2);
+	ASTNode* I_and_notB = create_node_binary(OP_AND, I_clone_2, not_condition);
 
 
 	// Create the implications for partial correctness
 	ASTNode* post_clone = clone_node(post);
-	ASTNode* right = create_node_binary("->", I_and_notB, post_clone);
+	ASTNode* right = create_node_binary(OP_IMPLY, I_and_notB, post_clone);
 
-	// Create I ∧ B again for the left side (since the previous one was consumed)
+	// Create I ∧ B again for the left side (a separate copy keeps the VC a tree)
 	// Build (I ∧ B) -> wp_body. i.e. {I ∧ B} S {I}.
 	ASTNode* I_clone_3 = clone_node(invariant);
 	ASTNode* condition_clone_3 = clone_node(condition);
-	ASTNode* I_and_B_for_left = create_node_binary("and", I_clone_3, condition_clone_3);
-	ASTNode* left = create_node_binary("->", I_and_B_for_left, wp_body);
+	ASTNode* I_and_B_for_left = create_node_binary(OP_AND, I_clone_3, condition_clone_3);
+	ASTNode* left = create_node_binary(OP_IMPLY, I_and_B_for_left, wp_body);
 
 	// Combine the two partial-correctness obligations: left ∧ right
-	ASTNode* partial_correctness = create_node_binary("and", left, right);
+	ASTNode* partial_correctness = create_node_binary(OP_AND,
+		create_node_label(rule_label("while", condition, "invariant preserved"), left),
+		create_node_label(rule_label("while", condition, "exit"), right));
 
 	/*
 		Termination checks (total correctness using a numeric variant)
-		We compute 'variant_after' by simulating the effect of assignments in the loop body
-		via substitution on the variant expression.
-		That is: variant_after = variant[x := E] for assignments x := E in the body.
+		'variant_after' is the variant in the state after one iteration,
+		from the same symbolic execution: variant[env] in one traversal.
+		If the body has inner loops, what their exits guarantee is assumed.
 	*/
-	ASTNode* variant_after = clone_node(variant);
-	line_linkedlist* cur = block_code->first;
-	while (cur != NULL) {
-		if (cur->node->type == NODE_ASSIGN) {
-			// Apply substitution variant_after[x := E]
-			ASTNode* tmp = substitute(variant_after, cur->node->Assign.id, cur->node->Assign.expr);
-			free_ASTNode(variant_after);
-			variant_after = tmp;
-		}
-		cur = cur->next;
-	}
-
-	// Now variant_after is the expression for the variant after one body execution
+	ASTNode* variant_after = substitute_env(variant, after.env);
+	free_SymState(&after);
 
 	// variant_after < variant 
 	ASTNode* variant_clone = clone_node(variant);
-	ASTNode* variant_decreases = create_node_binary("<", variant_after, variant_clone);
+	ASTNode* variant_decreases = create_node_binary(OP_LT, variant_after, variant_clone);
+	if (after.assumption) variant_decreases = create_node_binary(OP_IMPLY, after.assumption, variant_decreases);
  
 	//  variant >= 0 (we assume a natural-number domain for the variant)
 	ASTNode* variant_clone_2 = clone_node(variant);
-	ASTNode* variant_nonnegative = create_node_binary(">=", variant_clone_2, create_node_number(0));
+	ASTNode* variant_nonnegative = create_node_binary(OP_GE, variant_clone_2, create_node_number(0));
 
 	// combine both decrease and non-negativity: (variant_after < variant) ∧ (variant >= 0)
-	ASTNode* decrease_condition = create_node_binary("and", variant_decreases, variant_nonnegative);
+	ASTNode* decrease_condition = create_node_binary(OP_AND,
+		create_node_label(rule_label("while", condition, "variant decreases"), variant_decreases),
+		create_node_label(rule_label("while", condition, "variant non-negative"), variant_nonnegative));
 
 
 	// Create (I ∧ B) -> decrease_condition
 	ASTNode* I_clone_4 = clone_node(invariant);
 	ASTNode* condition_clone_4 = clone_node(condition);
-	ASTNode* I_and_B_for_term = create_node_binary("and", I_clone_4, condition_clone_4);
-	ASTNode* termination_condition = create_node_binary("->", I_and_B_for_term, decrease_condition);
+	ASTNode* I_and_B_for_term = create_node_binary(OP_AND, I_clone_4, condition_clone_4);
+	ASTNode* termination_condition = create_node_binary(OP_IMPLY, I_and_B_for_term, decrease_condition);
 
 
-	//  partial_correctness ∧ termination_condition
-	ASTNode* result = create_node_binary("and", partial_correctness, termination_condition);
-	
+	// Any state reached by iterating: what the body assigns is unknown
+	SubstEnv* state = create_SubstEnv();
+	int* assigned;
+	int count = block_assigned(block_code, &assigned);
+	for (int i = 0; i < count; i++) subst_env_bind(state, assigned[i], create_node_fresh(assigned[i], '@', ++loop_fresh));
+	free(assigned);
+
+	//  I ∧ (partial_correctness ∧ termination_condition)[state]
+	ASTNode* loop_checks = substitute_env(create_node_binary(OP_AND, partial_correctness, termination_condition), state);
+	free_SubstEnv(state);
+
+	ASTNode* entry = create_node_label(rule_label("while", condition, "invariant on entry"), clone_node(invariant));
+	ASTNode* result = create_node_binary(OP_AND, entry, loop_checks);
+
+	rule_depth--;
 	return result;
 }
 
@@ -245,44 +302,54 @@ int evaluate_formula(ASTNode* node) {
 
 	switch (node->type) {
 		case NODE_BIN_OP : {
-			// Logical connectors
-			if( strcmp(node->binary_op.op, "AND")==0 || strcmp(node->binary_op.op, "and")==0 ) 
-				return evaluate_formula(node->binary_op.left) 
-						&& evaluate_formula(node->binary_op.right);
-
-			if( strcmp(node->binary_op.op, "OR")==0 || strcmp(node->binary_op.op, "or")==0 ) 
-				return evaluate_formula(node->binary_op.left) 
-						|| evaluate_formula(node->binary_op.right);
-			
-			if( strcmp(node->binary_op.op, "->")==0 ) {
-				int L = evaluate_formula(node->binary_op.left);
-				int R = evaluate_formula(node->binary_op.right);
-				return !L || R;
+			switch (node->binary_op.op) {
+				// Logical connectors
+				case OP_AND:
+					return evaluate_formula(node->binary_op.left) 
+							&& evaluate_formula(node->binary_op.right);
+
+				case OP_OR:
+					return evaluate_formula(node->binary_op.left) 
+							|| evaluate_formula(node->binary_op.right);
+
+				case OP_IMPLY: {
+					int L = evaluate_formula(node->binary_op.left);
+					int R = evaluate_formula(node->binary_op.right);
+					return !L || R;
+				}
+
+				default:
+					break;
 			}
-				
+
 			// Comparison operators: evaluate numeric subexpressions
 			int L = evaluate_expr(node->binary_op.left);
 			int R = evaluate_expr(node->binary_op.right);
 
-			if( strcmp(node->binary_op.op, "==")==0 ) return L == R;
-			if( strcmp(node->binary_op.op, "!=")==0 ) return L != R;
-			if( strcmp(node->binary_op.op, "<")==0 ) return L < R;
-			if( strcmp(node->binary_op.op, ">")==0 ) return L > R;
-			if( strcmp(node->binary_op.op, ">=")==0 ) return L >= R;
-			if( strcmp(node->binary_op.op, "<=")==0 ) return L <= R;
-
+			switch (node->binary_op.op) {
+				case OP_EQ:		return L == R;
+				case OP_NEQ:	return L != R;
+				case OP_LT:		return L < R;
+				case OP_GT:		return L > R;
+				case OP_GE:		return L >= R;
+				case OP_LE:		return L <= R;
+				default:		break;
+			}
 			break;
 		}
 
 		case NODE_UNARY_OP: {
 			 // Unary logical NOT
-			if( strcmp(node->unary_op.op,"NOT")==0 || strcmp(node->unary_op.op,"not")==0 ){
+			if (node->unary_op.op == OP_NOT) {
 				int child = evaluate_formula(node->unary_op.child);
 				return !child;
 			}
 			break;
 		}
 
+		case NODE_LABEL:
+			return evaluate_formula(node->label.child);
+
 		default:
 			// Unexpected node types are treated as false and reported
 			fprintf(stderr, "evaluate_formula: unexpected node type %d\n", node->type);
@@ -306,10 +373,13 @@ int evaluate_expr (ASTNode* node) {
 		case NODE_BIN_OP: {
 			int L = evaluate_expr(node->binary_op.left);
 			int R = evaluate_expr(node->binary_op.right);
-			if (strcmp(node->binary_op.op, "+")==0)    return L + R;
-			if (strcmp(node->binary_op.op, "-")==0)    return L - R;
-			if (strcmp(node->binary_op.op, "*")==0)    return L * R;
-			if (strcmp(node->binary_op.op, "/")==0)    return L / R;
+			switch (node->binary_op.op) {
+				case OP_ADD:	return L + R;
+				case OP_SUB:	return L - R;
+				case OP_MUL:	return L * R;
+				case OP_DIV:	return L / R;
+				default:		break;
+			}
 			break;
 		}
 
@@ -318,13 +388,19 @@ int evaluate_expr (ASTNode* node) {
 			int arg2 = -1;
 			if(node->function.arg2 != NULL) arg2 = evaluate_expr(node->function.arg2);
 			
-
-			if( strcmp(node->function.fname,"min")==0 )		return (arg1 < arg2) ? arg1 : arg2;
-			if( strcmp(node->function.fname,"max")==0 ) 	return (arg1 < arg2) ? arg2 : arg1;
-			if ( strcmp(node->function.fname, "fact")==0 )	return fact(arg1);
+			switch (node->function.func) {
+				case FUNC_MIN:	return (arg1 < arg2) ? arg1 : arg2;
+				case FUNC_MAX:	return (arg1 < arg2) ? arg2 : arg1;
+				case FUNC_FACT:	return fact(arg1);
+			}
 			break;
 		}
 
+		case NODE_ITE:
+			return evaluate_formula(node->ite.condition)
+				? evaluate_expr(node->ite.then_term)
+				: evaluate_expr(node->ite.else_term);
+
 		default:
 			// Unexpected node type
 			fprintf(stderr, "evaluate_expr: unexpected node type %d\n", node->type);
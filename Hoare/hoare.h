@@ -9,10 +9,12 @@
 
 
 int is_node_true(ASTNode* node);
+const char* rule_label(const char* keyword, ASTNode* condition, const char* what);
 
-ASTNode* hoare_prover(DLL* code, ASTNode* pre, ASTNode* post);
+ASTNode* hoare_prover(DLL* code, ASTNode* post);
 ASTNode* hoare_statement(ASTNode* node, ASTNode* post);
 ASTNode* hoare_AssignmentRule(ASTNode* node, ASTNode* post);
+ASTNode* hoare_AssignmentBlock(ASTNode** assigns, int count, ASTNode* post);
 ASTNode* hoare_IfElseRule(ASTNode* node_IfElse, ASTNode* post);
 ASTNode* hoare_WhileRule(ASTNode* node, ASTNode* post);
 
@@ -0,0 +1,585 @@
+#include "interp.h"
+#include "hoare.h"
+#include "hashmap.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------
+	Concrete interpreter
+	A program and its annotations are compiled once to a flat code for
+	a stack machine. Its variables are slots numbered at compile time:
+		PRECONDITION P		P; ASSUME
+		x = E				E; STORE x
+		if (B) S else T		B; JUMP_FALSE l1; S; JUMP l2; l1: T; l2:
+		while (B) INVARIANT (I) VARIANT (V) S
+							I; CHECK "invariant on entry"
+					head:	B; JUMP_FALSE exit
+							V; STORE v; v >= 0; CHECK "variant non-negative"
+							S
+							I; CHECK "invariant preserved"
+							V < v; CHECK "variant decreases"
+							LOOP; JUMP head
+					exit:
+		POSTCONDITION Q		Q; CHECK "postcondition"; HALT
+	and, or and -> short-circuit, which is how Z3 reads them too
+	(false and x / 0 == 1 is false). Division and modulo are Z3's
+	(the remainder is never negative).
+	Values are 64-bit and Z3 integers are unbounded, so a run that
+	overflows is given up. So is one that divides by zero or takes fact
+	of a negative number (Z3 leaves these unspecified), or that runs
+	out of steps.
+	A failed check on inputs that satisfy the precondition is a real
+	bug in the program or its annotations: prescreen_program looks for
+	one before any VC is built.
+   ------------------------------------------------------------------ */
+
+#define PRESCREEN_STEPS		100000		// loop iterations per run
+#define PRESCREEN_TRIES		20			// samples per run asked for (precondition)
+
+typedef struct {
+	Bytecode* bc;
+	PtrMap* slots;			// interned name -> slot + 1
+	int depth;				// stack depth after the code emitted so far
+} Compiler;
+
+// Instruction of each comparison / arithmetic operator
+static const InstrKind binary_instr[] = {
+	[OP_ADD] = I_ADD, [OP_SUB] = I_SUB, [OP_MUL] = I_MUL, [OP_DIV] = I_DIV, [OP_MOD] = I_MOD,
+	[OP_LT] = I_LT, [OP_GT] = I_GT, [OP_LE] = I_LE, [OP_GE] = I_GE,
+	[OP_EQ] = I_EQ, [OP_NEQ] = I_NEQ,
+};
+
+
+static int emit(Compiler* c, InstrKind kind, int arg) {
+	Bytecode* bc = c->bc;
+	if (bc->count == bc->capacity) {
+		bc->capacity = bc->capacity ? 2 * bc->capacity : 64;
+		bc->code = realloc(bc->code, bc->capacity * sizeof(Instr));
+		if (!bc->code) { perror("realloc"); exit(1); }
+	}
+	bc->code[bc->count].kind = kind;
+	bc->code[bc->count].arg = arg;
+
+	switch (kind) {
+		case I_PUSH: case I_LOAD:
+			c->depth++;
+			break;
+		case I_NOT: case I_FACT: case I_JUMP: case I_LOOP: case I_HALT:
+			break;
+		default:	// binary operators, and what pops a condition
+			c->depth--;
+			break;
+	}
+	if (c->depth > bc->max_stack) bc->max_stack = c->depth;
+	return bc->count++;
+}
+
+// Make the jump at `at` go to the next instruction
+static void patch(Compiler* c, int at) {
+	c->bc->code[at].arg = c->bc->count;
+}
+
+static int add_check(Compiler* c, const char* label) {
+	Bytecode* bc = c->bc;
+	bc->checks = realloc(bc->checks, (bc->nchecks + 1) * sizeof(char*));
+	if (!bc->checks) { perror("realloc"); exit(1); }
+	bc->checks[bc->nchecks] = label;
+	return bc->nchecks++;
+}
+
+static int slot_of(Compiler* c, int sym) {
+	return (int)(intptr_t)ptrmap_get(c->slots, symbol_name(sym)) - 1;
+}
+
+
+// ----------------------------
+// Variables: a first pass numbers them in order of appearance
+// ----------------------------
+static void declare(Compiler* c, int sym) {
+	Bytecode* bc = c->bc;
+	if (ptrmap_get(c->slots, symbol_name(sym))) return;
+
+	bc->syms = realloc(bc->syms, (bc->nvars + 1) * sizeof(int));
+	if (!bc->syms) { perror("realloc"); exit(1); }
+	bc->syms[bc->nvars] = sym;
+	ptrmap_put(c->slots, symbol_name(sym), (void*)(intptr_t)(++bc->nvars));
+}
+
+static void declare_expr(Compiler* c, const ASTNode* node) {
+	if (!node) return;
+
+	switch (node->type) {
+		case NODE_ID:		declare(c, node->id_sym); break;
+		case NODE_BIN_OP:	declare_expr(c, node->binary_op.left); declare_expr(c, node->binary_op.right); break;
+		case NODE_UNARY_OP:	declare_expr(c, node->unary_op.child); break;
+		case NODE_FUNCTION:	declare_expr(c, node->function.arg1); declare_expr(c, node->function.arg2); break;
+		case NODE_LABEL:	declare_expr(c, node->label.child); break;
+		case NODE_ITE:
+			declare_expr(c, node->ite.condition);
+			declare_expr(c, node->ite.then_term);
+			declare_expr(c, node->ite.else_term);
+			break;
+		default:			break;
+	}
+}
+
+static void declare_block(Compiler* c, DLL* code) {
+	if (!code) return;
+
+	for (int i = 0; i < code->count; i++) {
+		ASTNode* node = code->stmts[i];
+		switch (node->type) {
+			case NODE_ASSIGN:
+				declare(c, node->Assign.sym);
+				declare_expr(c, node->Assign.expr);
+				break;
+			case NODE_IF_ELSE:
+				declare_expr(c, node->If.condition);
+				declare_block(c, node->If.block_if);
+				declare_block(c, node->If.block_else);
+				break;
+			case NODE_WHILE:
+				declare_expr(c, node->While.condition);
+				declare_expr(c, node->While.invariant);
+				declare_expr(c, node->While.variant);
+				declare_block(c, node->While.block_main);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+// Conjuncts x == k of the precondition fix x (sampling would rarely hit k)
+static void pin_inputs(Compiler* c, const ASTNode* pre) {
+	if (!pre) return;
+	if (pre->type == NODE_LABEL) { pin_inputs(c, pre->label.child); return; }
+	if (pre->type != NODE_BIN_OP) return;
+
+	if (pre->binary_op.op == OP_AND) {
+		pin_inputs(c, pre->binary_op.left);
+		pin_inputs(c, pre->binary_op.right);
+		return;
+	}
+	if (pre->binary_op.op != OP_EQ) return;
+
+	const ASTNode* var = pre->binary_op.left;
+	const ASTNode* value = pre->binary_op.right;
+	if (var->type == NODE_NUMBER) { var = pre->binary_op.right; value = pre->binary_op.left; }
+	if (var->type != NODE_ID || value->type != NODE_NUMBER) return;
+
+	int x = slot_of(c, var->id_sym);
+	c->bc->pinned[x] = 1;
+	c->bc->pin[x] = value->number;
+}
+
+
+// ----------------------------
+// Code generation. assigned[x]: x has been assigned on every path so far;
+// a variable read before that is an input of the program.
+// ----------------------------
+static void compile_expr(Compiler* c, const ASTNode* node, const char* assigned) {
+	switch (node->type) {
+		case NODE_NUMBER:
+			emit(c, I_PUSH, node->number);
+			break;
+
+		case NODE_BOOL:
+			emit(c, I_PUSH, node->bool_value);
+			break;
+
+		case NODE_ID: {
+			int x = slot_of(c, node->id_sym);
+			if (!assigned[x]) c->bc->input[x] = 1;
+			emit(c, I_LOAD, x);
+			break;
+		}
+
+		case NODE_LABEL:
+			compile_expr(c, node->label.child, assigned);
+			break;
+
+		case NODE_UNARY_OP:		// OP_NOT
+			compile_expr(c, node->unary_op.child, assigned);
+			emit(c, I_NOT, 0);
+			break;
+
+		case NODE_BIN_OP: {
+			OpCode op = node->binary_op.op;
+			compile_expr(c, node->binary_op.left, assigned);
+
+			if (op == OP_AND || op == OP_OR || op == OP_IMPLY) {
+				// a -> b is (not a) or b
+				if (op == OP_IMPLY) emit(c, I_NOT, 0);
+				int skip = emit(c, op == OP_AND ? I_AND : I_OR, 0);
+				compile_expr(c, node->binary_op.right, assigned);
+				patch(c, skip);
+			} else {
+				compile_expr(c, node->binary_op.right, assigned);
+				emit(c, binary_instr[op], 0);
+			}
+			break;
+		}
+
+		case NODE_FUNCTION:
+			compile_expr(c, node->function.arg1, assigned);
+			if (node->function.func == FUNC_FACT) {
+				emit(c, I_FACT, 0);
+			} else {
+				compile_expr(c, node->function.arg2, assigned);
+				emit(c, node->function.func == FUNC_MIN ? I_MIN : I_MAX, 0);
+			}
+			break;
+
+		case NODE_ITE: {
+			compile_expr(c, node->ite.condition, assigned);
+			int to_else = emit(c, I_JUMP_FALSE, 0);
+			compile_expr(c, node->ite.then_term, assigned);
+			int to_end = emit(c, I_JUMP, 0);
+			c->depth--;		// only one of the two terms is pushed
+			patch(c, to_else);
+			compile_expr(c, node->ite.else_term, assigned);
+			patch(c, to_end);
+			break;
+		}
+
+		default:
+			fprintf(stderr, "compile_program: unexpected node type %d\n", node->type);
+			emit(c, I_PUSH, 0);
+			break;
+	}
+}
+
+static void compile_block(Compiler* c, DLL* code, char* assigned);
+
+static char* copy_assigned(const Compiler* c, const char* assigned) {
+	char* copy = malloc(c->bc->nvars ? c->bc->nvars : 1);
+	if (!copy) { perror("malloc"); exit(1); }
+	memcpy(copy, assigned, c->bc->nvars);
+	return copy;
+}
+
+static void compile_if(Compiler* c, ASTNode* node, char* assigned) {
+	char* then_assigned = copy_assigned(c, assigned);
+	char* else_assigned = copy_assigned(c, assigned);
+
+	compile_expr(c, node->If.condition, assigned);
+	int to_else = emit(c, I_JUMP_FALSE, 0);
+	compile_block(c, node->If.block_if, then_assigned);
+	int to_end = emit(c, I_JUMP, 0);
+	patch(c, to_else);
+	compile_block(c, node->If.block_else, else_assigned);
+	patch(c, to_end);
+
+	for (int x = 0; x < c->bc->nvars; x++) assigned[x] = then_assigned[x] && else_assigned[x];
+	free(then_assigned);
+	free(else_assigned);
+}
+
+static void compile_while(Compiler* c, ASTNode* node, char* assigned) {
+	ASTNode* condition = node->While.condition;
+	int variant = c->bc->nslots++;		// value of the variant at the top of the iteration
+
+	compile_expr(c, node->While.invariant, assigned);
+	emit(c, I_CHECK, add_check(c, rule_label("while", condition, "invariant on entry")));
+
+	// The body may not run: what it assigns is not assigned after the loop
+	char* body = copy_assigned(c, assigned);
+	int head = c->bc->count;
+	compile_expr(c, condition, assigned);
+	int to_exit = emit(c, I_JUMP_FALSE, 0);
+
+	compile_expr(c, node->While.variant, body);
+	emit(c, I_STORE, variant);
+	emit(c, I_LOAD, variant);
+	emit(c, I_PUSH, 0);
+	emit(c, I_GE, 0);
+	emit(c, I_CHECK, add_check(c, rule_label("while", condition, "variant non-negative")));
+
+	compile_block(c, node->While.block_main, body);
+
+	compile_expr(c, node->While.invariant, body);
+	emit(c, I_CHECK, add_check(c, rule_label("while", condition, "invariant preserved")));
+	compile_expr(c, node->While.variant, body);
+	emit(c, I_LOAD, variant);
+	emit(c, I_LT, 0);
+	emit(c, I_CHECK, add_check(c, rule_label("while", condition, "variant decreases")));
+
+	emit(c, I_LOOP, 0);
+	emit(c, I_JUMP, head);
+	patch(c, to_exit);
+	free(body);
+}
+
+static void compile_block(Compiler* c, DLL* code, char* assigned) {
+	if (!code) return;
+
+	for (int i = 0; i < code->count; i++) {
+		ASTNode* node = code->stmts[i];
+		switch (node->type) {
+			case NODE_ASSIGN: {
+				int x = slot_of(c, node->Assign.sym);
+				compile_expr(c, node->Assign.expr, assigned);
+				emit(c, I_STORE, x);
+				assigned[x] = 1;
+				break;
+			}
+			case NODE_IF_ELSE:
+				compile_if(c, node, assigned);
+				break;
+			case NODE_WHILE:
+				compile_while(c, node, assigned);
+				break;
+			default:
+				fprintf(stderr, "compile_program: unsupported node type %d\n", node->type);
+				break;
+		}
+	}
+}
+
+// Compile a parsed program (see above). Check labels are allocated
+// from the AST arena, so the code must not outlive the program.
+Bytecode* compile_program(DLL* program) {
+	Bytecode* bc = calloc(1, sizeof(Bytecode));
+	if (!bc) { perror("calloc"); exit(1); }
+
+	Compiler c = { bc, create_PtrMap(64), 0 };
+	declare_expr(&c, program->pre);
+	declare_block(&c, program);
+	declare_expr(&c, program->post);
+	bc->nslots = bc->nvars;
+
+	size_t n = bc->nvars ? bc->nvars : 1;
+	bc->input = calloc(n, 1);
+	bc->pinned = calloc(n, 1);
+	bc->pin = calloc(n, sizeof(long long));
+	char* assigned = calloc(n, 1);
+	if (!bc->input || !bc->pinned || !bc->pin || !assigned) { perror("calloc"); exit(1); }
+
+	pin_inputs(&c, program->pre);
+	if (program->pre) {
+		compile_expr(&c, program->pre, assigned);
+		emit(&c, I_ASSUME, 0);
+	}
+	compile_block(&c, program, assigned);
+	if (program->post) {
+		compile_expr(&c, program->post, assigned);
+		emit(&c, I_CHECK, add_check(&c, "postcondition"));
+	}
+	emit(&c, I_HALT, 0);
+
+	free(assigned);
+	free_PtrMap(c.slots);
+	return bc;
+}
+
+void free_Bytecode(Bytecode* bc) {
+	if (!bc) return;
+
+	free(bc->code);
+	free(bc->syms);
+	free(bc->input);
+	free(bc->pinned);
+	free(bc->pin);
+	free(bc->checks);
+	free(bc);
+}
+
+
+// ----------------------------
+// Execution
+// ----------------------------
+
+// Run the code from `slots` (inputs set, nslots values) with a stack of
+// max_stack values; at most `steps` loop iterations in all. On
+// RUN_FAILED, *failed is the number of the check (bc->checks).
+RunStatus run_Bytecode(const Bytecode* bc, long long* slots, long long* stack, long steps, int* failed) {
+	const Instr* code = bc->code;
+	int pc = 0;
+	int sp = 0;		// stack[sp - 1] is the top
+
+	for (;;) {
+		const Instr* in = &code[pc++];
+		long long a, b;
+
+		switch (in->kind) {
+			case I_PUSH:	stack[sp++] = in->arg; break;
+			case I_LOAD:	stack[sp++] = slots[in->arg]; break;
+			case I_STORE:	slots[in->arg] = stack[--sp]; break;
+
+			case I_ADD:
+				if (__builtin_add_overflow(stack[sp - 2], stack[sp - 1], &stack[sp - 2])) return RUN_UNDEFINED;
+				sp--;
+				break;
+			case I_SUB:
+				if (__builtin_sub_overflow(stack[sp - 2], stack[sp - 1], &stack[sp - 2])) return RUN_UNDEFINED;
+				sp--;
+				break;
+			case I_MUL:
+				if (__builtin_mul_overflow(stack[sp - 2], stack[sp - 1], &stack[sp - 2])) return RUN_UNDEFINED;
+				sp--;
+				break;
+
+			case I_DIV:
+			case I_MOD: {
+				a = stack[sp - 2];
+				b = stack[sp - 1];
+				if (b == 0 || (a == LLONG_MIN && b == -1)) return RUN_UNDEFINED;
+
+				// a = b * q + r with 0 <= r < |b|
+				long long q = a / b, r = a % b;
+				if (r < 0) {
+					if (b > 0) { q--; r += b; }
+					else { q++; r -= b; }
+				}
+				stack[sp - 2] = in->kind == I_DIV ? q : r;
+				sp--;
+				break;
+			}
+
+			case I_LT:	sp--; stack[sp - 1] = stack[sp - 1] < stack[sp]; break;
+			case I_GT:	sp--; stack[sp - 1] = stack[sp - 1] > stack[sp]; break;
+			case I_LE:	sp--; stack[sp - 1] = stack[sp - 1] <= stack[sp]; break;
+			case I_GE:	sp--; stack[sp - 1] = stack[sp - 1] >= stack[sp]; break;
+			case I_EQ:	sp--; stack[sp - 1] = stack[sp - 1] == stack[sp]; break;
+			case I_NEQ:	sp--; stack[sp - 1] = stack[sp - 1] != stack[sp]; break;
+			case I_NOT:	stack[sp - 1] = !stack[sp - 1]; break;
+
+			case I_MIN:	sp--; if (stack[sp] < stack[sp - 1]) stack[sp - 1] = stack[sp]; break;
+			case I_MAX:	sp--; if (stack[sp] > stack[sp - 1]) stack[sp - 1] = stack[sp]; break;
+
+			case I_FACT: {
+				a = stack[sp - 1];
+				if (a < 0 || a > 20) return RUN_UNDEFINED;		// 21! overflows
+				long long f = 1;
+				for (long long k = 2; k <= a; k++) f *= k;
+				stack[sp - 1] = f;
+				break;
+			}
+
+			case I_JUMP:		pc = in->arg; break;
+			case I_JUMP_FALSE:	if (!stack[--sp]) pc = in->arg; break;
+			case I_AND:			if (!stack[sp - 1]) pc = in->arg; else sp--; break;
+			case I_OR:			if (stack[sp - 1]) pc = in->arg; else sp--; break;
+
+			case I_ASSUME:
+				if (!stack[--sp]) return RUN_PRE_FALSE;
+				break;
+			case I_CHECK:
+				if (!stack[--sp]) { *failed = in->arg; return RUN_FAILED; }
+				break;
+			case I_LOOP:
+				if (--steps < 0) return RUN_OUT_OF_STEPS;
+				break;
+			case I_HALT:
+				return RUN_PASSED;
+		}
+	}
+}
+
+
+// ----------------------------
+// Random inputs, reproducible from run to run for a given seed
+// ----------------------------
+
+// xorshift64*
+static unsigned long long next_random(unsigned long long* state) {
+	unsigned long long x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Mostly small values, where off-by-one mistakes show
+static long long random_value(unsigned long long* state) {
+	unsigned long long r = next_random(state);
+	switch (r & 7) {
+		case 0:		return 0;
+		case 1:		return 1;
+		case 2:		return -1;
+		case 3:
+		case 4:
+		case 5:		return (long long)((r >> 8) % 11);
+		case 6:		return (long long)((r >> 8) % 41) - 20;
+		default:	return (long long)((r >> 8) % 401) - 200;
+	}
+}
+
+// Fill the slots for a run: pinned inputs get their value, other inputs
+// a random one, everything else 0. state must not be 0.
+void random_inputs(const Bytecode* bc, long long* slots, unsigned long long* state) {
+	for (int x = 0; x < bc->nslots; x++) {
+		if (x < bc->nvars && bc->pinned[x]) slots[x] = bc->pin[x];
+		else if (x < bc->nvars && bc->input[x]) slots[x] = random_value(state);
+		else slots[x] = 0;
+	}
+}
+
+// "n = 3, x = 0": the inputs in slots (arena string)
+const char* inputs_to_string(const Bytecode* bc, const long long* slots) {
+	char* text = NULL;
+	size_t len = 0;
+	FILE* mem = open_memstream(&text, &len);
+	if (!mem) { perror("open_memstream"); exit(1); }
+
+	int n = 0;
+	for (int x = 0; x < bc->nvars; x++) {
+		if (!bc->input[x]) continue;
+		fprintf(mem, "%s%s = %lld", n++ ? ", " : "", symbol_name(bc->syms[x]), slots[x]);
+	}
+	fclose(mem);
+
+	const char* result = ast_strdup(text);
+	free(text);
+	return result;
+}
+
+// ----------------------------
+// Pre-screening
+// ----------------------------
+
+// Run `program` on up to `runs` random inputs that satisfy its
+// precondition. Returns 1 if a check failed (result->failed says which,
+// result->inputs on what), 0 otherwise: no verdict either way.
+int prescreen_program(DLL* program, int runs, PrescreenResult* result) {
+	memset(result, 0, sizeof(PrescreenResult));
+	Bytecode* bc = compile_program(program);
+
+	long long* slots = malloc((bc->nslots ? bc->nslots : 1) * sizeof(long long));
+	long long* stack = malloc((bc->max_stack ? bc->max_stack : 1) * sizeof(long long));
+	long long* inputs = malloc((bc->nvars ? bc->nvars : 1) * sizeof(long long));
+	if (!slots || !stack || !inputs) { perror("malloc"); exit(1); }
+
+	unsigned long long state = 0x9E3779B97F4A7C15ULL;
+	long tries = (long)runs * PRESCREEN_TRIES;
+	int found = 0;
+
+	for (long t = 0; t < tries && result->runs < runs; t++) {
+		random_inputs(bc, slots, &state);
+		memcpy(inputs, slots, bc->nvars * sizeof(long long));	// the run overwrites them
+
+		int failed;
+		RunStatus status = run_Bytecode(bc, slots, stack, PRESCREEN_STEPS, &failed);
+		if (status == RUN_PRE_FALSE) continue;
+
+		result->runs++;
+		if (status == RUN_UNDEFINED || status == RUN_OUT_OF_STEPS) result->inconclusive++;
+		if (status == RUN_FAILED) {
+			result->failed = bc->checks[failed];
+			result->inputs = inputs_to_string(bc, inputs);
+			found = 1;
+			break;
+		}
+	}
+
+	free(slots);
+	free(stack);
+	free(inputs);
+	free_Bytecode(bc);
+	return found;
+}
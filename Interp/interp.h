@@ -0,0 +1,61 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include "ast.h"
+
+// Instructions of the stack machine (see interp.c)
+typedef enum { I_PUSH, I_LOAD, I_STORE,
+					I_ADD, I_SUB, I_MUL, I_DIV, I_MOD,
+					I_LT, I_GT, I_LE, I_GE, I_EQ, I_NEQ, I_NOT,
+					I_MIN, I_MAX, I_FACT,
+					I_JUMP, I_JUMP_FALSE, I_AND, I_OR,
+					I_ASSUME, I_CHECK, I_LOOP, I_HALT } InstrKind;
+
+typedef struct {
+	InstrKind kind;
+	int arg;				// constant, slot, jump target or check number
+} Instr;
+
+// A program with its annotations, compiled for concrete runs. Read-only
+// once compiled: any number of threads may run it, each with its own slots.
+typedef struct Bytecode_ {
+	Instr* code;
+	int count;
+	int capacity;
+	int nslots;				// variables first, then one hidden slot per loop
+	int nvars;
+	int* syms;				// symbol of each variable
+	char* input;			// input[x]: x may be read before it is assigned
+	char* pinned;			// pinned[x]: the precondition fixes x to pin[x]
+	long long* pin;
+	const char** checks;	// label of each CHECK (arena strings)
+	int nchecks;
+	int max_stack;
+} Bytecode;
+
+typedef enum {
+	RUN_PASSED,				// every check held
+	RUN_PRE_FALSE,			// the inputs do not satisfy the precondition
+	RUN_FAILED,				// a check failed
+	RUN_UNDEFINED,			// overflow, division by zero, fact of a negative
+	RUN_OUT_OF_STEPS		// too many loop iterations
+} RunStatus;
+
+// Outcome of prescreen_program
+typedef struct {
+	int runs;				// runs on inputs that satisfy the precondition
+	int inconclusive;		// of which given up (RUN_UNDEFINED, RUN_OUT_OF_STEPS)
+	const char* failed;		// label of the failed check (NULL: none failed)
+	const char* inputs;		// inputs of the failing run: "n = 3, x = 0"
+} PrescreenResult;
+
+
+Bytecode* compile_program(DLL* program);
+void free_Bytecode(Bytecode* bc);
+RunStatus run_Bytecode(const Bytecode* bc, long long* slots, long long* stack, long steps, int* failed);
+void random_inputs(const Bytecode* bc, long long* slots, unsigned long long* state);
+const char* inputs_to_string(const Bytecode* bc, const long long* slots);
+
+int prescreen_program(DLL* program, int runs, PrescreenResult* result);
+
+#endif
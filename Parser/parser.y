@@ -6,21 +6,54 @@
 	#include "../Hoare/hoare.h"
 	#include "../Z3/z3_helpers.h"
 	#include "../Hashmap/hashmap.h"
-	#include "../Hoare/hoare.h"
-
-
-	DLL* root = NULL;
+	#include "../Arena/arena.h"
+	#include "../Vc/vc.h"
+	#include "../Solver/solver.h"
+	#include "../Verifier/verifier.h"
+	#include "../Server/server.h"
+	#include "../Cache/cache.h"
+	#include "../Fuzz/fuzz.h"
+	#include "../Stats/stats.h"
+	#include <unistd.h>
 
-	void yyerror(const char *s);
-	int yylex(void);
-	extern int yylex_destroy(void);
 	//int yydebug = 1;
 
 %}
 
+/* Pure parser over a reentrant scanner: no globals, the program is
+   returned through the `result` parameter. */
+%define api.pure full
+%param { yyscan_t scanner }
+%parse-param { DLL** result }
+
+%code requires {
+	#include "../Ast/ast.h"
+
+	#ifndef YY_TYPEDEF_YY_SCANNER_T
+	#define YY_TYPEDEF_YY_SCANNER_T
+	typedef void* yyscan_t;
+	#endif
+}
+
+%code provides {
+	DLL* parse_program(FILE* in);
+	DLL* parse_string(const char* text);
+}
+
+%code {
+	// Reentrant flex interface (Lexer/lexer.l)
+	int yylex(YYSTYPE* yylval, yyscan_t scanner);
+	int yylex_init(yyscan_t* scanner);
+	int yylex_destroy(yyscan_t scanner);
+	void yyset_in(FILE* in, yyscan_t scanner);
+	struct yy_buffer_state* yy_scan_string(const char* text, yyscan_t scanner);
+
+	void yyerror(yyscan_t scanner, DLL** result, const char* s);
+}
+
 %union {
 	int num;
-	char *id;
+	int sym;
 	ASTNode* node;
 	DLL* dll;
 }
@@ -41,7 +74,7 @@
 %token NEQ
 %token NOT
 
-%token <id> IDENTIFIER 
+%token <sym> IDENTIFIER 
 %token <num> NUMBER 
 %type <node> statement expr condition precond postcond
 %type <dll> block statements
@@ -60,9 +93,9 @@
 /* Grammar rules and actions */
 program:
 	statements precond postcond {
-		root = $1;
-		root->pre = $2;
-		root->post = $3;
+		*result = $1;
+		(*result)->pre = $2;
+		(*result)->post = $3;
 	}
 ;
 
@@ -83,7 +116,6 @@ postcond:
 statement:
  	IDENTIFIER ASSIGN expr SEMICOLON { 
 		$$ = create_node_assign($1, $3);
-		free($1);
 	}
 
 	| IF LPAREN condition RPAREN block ELSE block { 
@@ -120,146 +152,316 @@ block:
 ;
 
 condition:
-	  expr LT expr					{ $$ = create_node_binary("<", $1, $3); }
-	| expr GT expr					{ $$ = create_node_binary(">", $1, $3); }
-	| expr GE expr					{ $$ = create_node_binary(">=", $1, $3); }
-	| expr LE expr					{ $$ = create_node_binary("<=", $1, $3); }
-	| expr EQ expr					{ $$ = create_node_binary("==", $1, $3); }
-	| expr NEQ expr					{ $$ = create_node_binary("!=", $1, $3); }
+	  expr LT expr					{ $$ = create_node_binary(OP_LT, $1, $3); }
+	| expr GT expr					{ $$ = create_node_binary(OP_GT, $1, $3); }
+	| expr GE expr					{ $$ = create_node_binary(OP_GE, $1, $3); }
+	| expr LE expr					{ $$ = create_node_binary(OP_LE, $1, $3); }
+	| expr EQ expr					{ $$ = create_node_binary(OP_EQ, $1, $3); }
+	| expr NEQ expr					{ $$ = create_node_binary(OP_NEQ, $1, $3); }
 	| TRUE							{ $$ = create_node_bool(1); }
 	| FALSE							{ $$ = create_node_bool(0); }
-	| condition AND condition		{ $$ = create_node_binary("and", $1, $3); }
-	| condition OR condition		{ $$ = create_node_binary("or", $1, $3); }
-	| NOT condition					{ $$ = create_node_unary("not", $2); }
+	| condition AND condition		{ $$ = create_node_binary(OP_AND, $1, $3); }
+	| condition OR condition		{ $$ = create_node_binary(OP_OR, $1, $3); }
+	| NOT condition					{ $$ = create_node_unary(OP_NOT, $2); }
 	| LPAREN condition RPAREN		{ $$ = $2; }
-	| condition IMPLY condition		{ $$ = create_node_binary("->", $1, $3); }
+	| condition IMPLY condition		{ $$ = create_node_binary(OP_IMPLY, $1, $3); }
 	| expr							{ $$ = $1; }
 ;
 
 expr:
 	  NUMBER								{ $$ = create_node_number($1); }
-	| IDENTIFIER							{ $$ = create_node_id($1); free($1);}
-	| expr PLUS expr						{ $$ = create_node_binary("+", $1, $3); }
-	| expr MINUS expr						{ $$ = create_node_binary("-", $1, $3); }
-	| expr MUL expr							{ $$ = create_node_binary("*", $1, $3); }
-	| expr DIV expr							{ $$ = create_node_binary("/", $1, $3); }
-	| expr MOD expr							{ $$ = create_node_binary("%", $1, $3); }
+	| IDENTIFIER							{ $$ = create_node_symbol($1); }
+	| expr PLUS expr						{ $$ = create_node_binary(OP_ADD, $1, $3); }
+	| expr MINUS expr						{ $$ = create_node_binary(OP_SUB, $1, $3); }
+	| expr MUL expr							{ $$ = create_node_binary(OP_MUL, $1, $3); }
+	| expr DIV expr							{ $$ = create_node_binary(OP_DIV, $1, $3); }
+	| expr MOD expr							{ $$ = create_node_binary(OP_MOD, $1, $3); }
 	| LPAREN expr RPAREN 					{ $$ = $2; }
-	| MIN LPAREN expr COMMA expr RPAREN		{ $$ = create_node_Func("min", $3, $5); }
-	| MAX LPAREN expr COMMA expr RPAREN		{ $$ = create_node_Func("max", $3, $5); }
-	| FACT LPAREN expr RPAREN				{ $$ = create_node_Func("fact", $3, NULL); }
+	| MIN LPAREN expr COMMA expr RPAREN		{ $$ = create_node_Func(FUNC_MIN, $3, $5); }
+	| MAX LPAREN expr COMMA expr RPAREN		{ $$ = create_node_Func(FUNC_MAX, $3, $5); }
+	| FACT LPAREN expr RPAREN				{ $$ = create_node_Func(FUNC_FACT, $3, NULL); }
 ;
 
 %%
 /* Additional C code (functions, main, helpers) */
 
-void yyerror(const char *s) {
+void yyerror(yyscan_t scanner, DLL** result, const char* s) {
+	(void)scanner;
+	(void)result;
 	fprintf(stderr, "Parse error: %s\n", s);
 }
 
-Z3_func_decl fact_func;
 
 
+// Parse one program from `in` into the calling thread's AST arena;
+// NULL on a syntax error. Safe to call from several threads at once.
+DLL* parse_program(FILE* in) {
+	yyscan_t scanner;
+	DLL* result = NULL;
 
-int main() {
-	printf("Start parsing...\n");
+	if (yylex_init(&scanner) != 0) { perror("yylex_init"); exit(1); }
+	yyset_in(in, scanner);
+	int status = yyparse(scanner, &result);
 
+	// Free lexer state after parsing (also drops unread input)
+	yylex_destroy(scanner);
+	return status == 0 ? result : NULL;
+}
 
-	// ----------------------------
-	// Parse input program
-	// ----------------------------
-	if (yyparse() == 0) {
-		printf("Parsing done.\n"); // root now points to your DLL with all statements
-	} else {
-		printf("Parsing failed.\n");
-		return -1;
+// Same as parse_program, reading the program from a string
+DLL* parse_string(const char* text) {
+	yyscan_t scanner;
+	DLL* result = NULL;
+
+	if (yylex_init(&scanner) != 0) { perror("yylex_init"); exit(1); }
+	yy_scan_string(text, scanner);
+	int status = yyparse(scanner, &result);
+
+	yylex_destroy(scanner);
+	return status == 0 ? result : NULL;
+}
+
+
+// Print at most `max` characters of a formula on one line
+static void print_formula_short(ASTNode* node, size_t max) {
+	char* text = formula_to_string(node);
+	if (strlen(text) > max) printf("%.*s ...", (int)max, text);
+	else printf("%s", text);
+}
+
+// Human-readable report of one verified program (single-file mode)
+static void print_report(const VerifyResult* res, int jobs, int portfolio) {
+	ObligationList* obligations = res->obligations;
+	ObligationResult* results = res->results;
+
+	if (res->prescreen.failed) {
+		// A concrete run broke an annotation: no VC was built
+		printf("Pre-screen: %s fails on %s (run %d)\n", res->prescreen.failed,
+			res->prescreen.inputs[0] ? res->prescreen.inputs : "(any input)", res->prescreen.runs);
+		printf(RED "Interpreter says: The program is NOT correct!\n" RESET);
+		return;
+	}
+	if (res->prescreen.runs) {
+		printf("Pre-screen: %d run(s) passed (%d inconclusive)\n", res->prescreen.runs, res->prescreen.inconclusive);
 	}
 
-	// Free lexer state after parsing
-	yylex_destroy();
+	printf("VC size: %llu nodes as a tree, %lu distinct, %lu allocated\n",
+		res->vc_tree_nodes, res->vc_distinct_nodes, res->nodes_allocated);
+	if (res->vc_raw_nodes != res->vc_tree_nodes) {
+		// Signed: the passes may also grow a VC (the counts are unsigned)
+		double change = 100.0 * ((double)res->vc_tree_nodes - (double)res->vc_raw_nodes) / res->vc_raw_nodes;
+		printf("%s from %llu nodes (%+.1f%%)\n", change < 0 ? "Reduced" : "Grew",
+			res->vc_raw_nodes, change);
+	}
 
-	
-	printf("Starting verification...\n");
+	int nworkers = jobs < obligations->count ? jobs : obligations->count;
+	if (nworkers < 1) nworkers = 1;
+	printf("%d obligation(s), %d solver thread(s)\n", obligations->count, nworkers);
+
+	for (int i = 0; i < obligations->count; i++) {
+		Obligation* ob = &obligations->items[i];
+		printf("  [%d/%d] %-9s %s\n", i + 1, obligations->count, verdict_to_string(results[i].verdict), ob->label);
+
+		// Failed obligations: show what could not be proved, and why
+		if (results[i].verdict != VERDICT_VALID) {
+			printf("          goal: ");
+			print_formula_short(ob->goal, 100);
+			printf("\n");
+		}
+		if (results[i].model) {
+			printf("          counterexample: %s\n", results[i].model[0] ? results[i].model : "(any state)");
+		}
+		if (results[i].reason) {
+			printf("          reason: %s\n", results[i].reason);
+		}
+		if (portfolio && results[i].strategy) {
+			printf("          answered by: %s\n", results[i].strategy);
+		}
+	}
+	if (res->cache_hits + res->cache_misses > 0) {
+		printf("Proof cache: %d hit(s), %d miss(es)\n", res->cache_hits, res->cache_misses);
+	}
 
-	
-	// ----------------------------
-	// Sanity check: reject pre = true (unsupported)
-	// ----------------------------
-	if (is_node_true(root->pre)) {
-		printf(RED "ERROR -> \"PRECONDITION: true\" is not supported\n" RESET);
-		free_DLL(root);  // cleanup AST
-		return 1;
+	if (res->status == PROGRAM_INCORRECT) {
+		// SAT(¬VC) for some obligation ⇒ counterexample exists
+		printf(RED "Z3 says: The program is NOT correct!\n" RESET);
+	} 
+	else if (res->status == PROGRAM_CORRECT) {
+		// UNSAT(¬VC) for every obligation ⇒ VC is valid
+		printf(GREEN "Z3 says: The program is correct!\n" RESET);
+	} 
+	else {
+		printf("Z3 says: Unknown result.\n");
 	}
+}
 
-	// ----------------------------
-	// Generate verification condition (VC) from program
-	// ----------------------------
-	ASTNode* result = hoare_prover(root, root->pre, root->post);
-	ASTNode* vc = create_node_binary("->", clone_node(root->pre), clone_node(result));
+// Throughput and the checks that failed, with their smallest input (fuzz mode)
+static void print_fuzz_report(const FuzzReport* report) {
+	printf("%llu state(s) in %.2f s on %d thread(s): %.0f states/s\n", report->states,
+		report->seconds, report->threads, report->seconds > 0 ? report->states / report->seconds : 0.0);
+	printf("%llu satisfy the precondition, %llu inconclusive\n", report->runs, report->inconclusive);
 
-	// ----------------------------
-	// Setup Z3 solver
-	// ----------------------------
-	Z3_config cfg = Z3_mk_config();
-	Z3_context ctx = Z3_mk_context(cfg);
-	Z3_del_config(cfg);
+	for (int i = 0; i < report->nfailures; i++) {
+		const FuzzFailure* f = &report->failures[i];
+		printf("  FAILED %s: %llu run(s), smallest input: %s\n", f->label, f->failures,
+			f->inputs[0] ? f->inputs : "(any input)");
+	}
 
-	init_z3(ctx); // user-defined funcs like fact
+	if (report->nfailures) printf(RED "Fuzzer says: some annotations do not hold!\n" RESET);
+	else if (report->runs == 0) printf("Fuzzer says: no input satisfies the precondition.\n");
+	else printf(GREEN "Fuzzer says: no violation found.\n" RESET);
+}
 
-	Z3_solver solver = Z3_mk_solver(ctx);
-	Z3_solver_inc_ref(ctx, solver);
+// Release the verifier, write back the proof cache, report --stats and let Z3 free its memory
+static void shutdown(Verifier* verifier) {
+	ProofCache* cache = verifier->opts.cache;
 
+	free_Verifier(verifier);
+	if (cache) {
+		save_ProofCache(cache);
+		free_ProofCache(cache);
+	}
+	if (stats_enabled) fprint_stats_json(stderr);
+	Z3_finalize_memory();
+}
 
-	// Cache for variables (so we reuse Z3 symbols consistently)
-	HashMap* var_cache = create_HashMap(16);
+int main(int argc, char** argv) {
+	VerifierOptions opts = { (int)sysconf(_SC_NPROCESSORS_ONLN), 1, 1, 0, 0, NULL, { 0, 0, 0, 0 } };
+	const char* cache_path = NULL;
+	int batch_from = 0;
+	int server_mode = 0;
+	const char* socket_path = NULL;
+	double fuzz_seconds = 0;
 
+	// ----------------------------
+	// Command-line options
+	// ----------------------------
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--share") == 0) {
+			ast_set_sharing(1); // hash-cons VC subterms into a DAG
+		} else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+			opts.jobs = atoi(argv[++i]); // solver threads, one Z3 context each
+		} else if (strcmp(argv[i], "--no-split") == 0) {
+			opts.split = 0; // check the whole VC with a single solver call
+		} else if (strcmp(argv[i], "--no-simplify") == 0) {
+			opts.simplify = 0; // hand the VC to Z3 as the Hoare rules built it
+		} else if (strcmp(argv[i], "--vcgen") == 0 && i + 1 < argc) {
+			const char* mode = argv[++i]; // how the VC is built
+			if (strcmp(mode, "passive") == 0) opts.passive = 1;
+			else if (strcmp(mode, "hoare") == 0) opts.passive = 0;
+			else { fprintf(stderr, "unknown VC generator: %s (hoare, passive)\n", mode); return 2; }
+		} else if (strcmp(argv[i], "--prescreen") == 0 && i + 1 < argc) {
+			opts.prescreen = atoi(argv[++i]); // random concrete runs before building the VC
+		} else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc) {
+			fuzz_seconds = atof(argv[++i]); // run the annotations on random inputs instead of proving them
+		} else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+			opts.solver.timeout_ms = (unsigned)strtoul(argv[++i], NULL, 10); // per obligation
+		} else if (strcmp(argv[i], "--rlimit") == 0 && i + 1 < argc) {
+			opts.solver.rlimit = (unsigned)strtoul(argv[++i], NULL, 10); // per obligation
+		} else if (strcmp(argv[i], "--portfolio") == 0) {
+			opts.solver.portfolio = 1; // race several Z3 strategies per obligation
+		} else if (strcmp(argv[i], "--incremental") == 0) {
+			opts.solver.incremental = 1; // push shared hypotheses once per worker
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			stats_enable(); // phase times and counters as JSON on stderr
+		} else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			cache_path = argv[++i]; // reuse verdicts of unchanged obligations
+		} else if (strcmp(argv[i], "--server") == 0) {
+			server_mode = 1; // answer VERIFY requests on stdin
+		} else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+			server_mode = 1; // ... or on a Unix socket
+			socket_path = argv[++i];
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			batch_from = i + 1; // the remaining arguments are files or directories
+			break;
+		} else {
+			fprintf(stderr, "usage: %s [OPTIONS] < program.t\n"
+							"       %s [OPTIONS] --batch FILE|DIR...\n"
+							"       %s [OPTIONS] --server [--socket PATH]\n"
+							"options: --share, -j N, --no-split, --no-simplify, --vcgen hoare|passive, --prescreen N, --fuzz SECONDS, --cache FILE, --timeout MS, --rlimit N, --portfolio, --incremental, --stats\n", argv[0], argv[0], argv[0]);
+			return 2;
+		}
+	}
+	if (opts.jobs < 1) opts.jobs = 1;
 
 	// ----------------------------
-	// Translate VC into Z3 formula
+	// Fuzz mode: concrete runs only, no Z3
 	// ----------------------------
-	Z3_ast res = ast_to_z3(ctx, vc, var_cache);
-	Z3_inc_ref(ctx, res);
+	if (fuzz_seconds > 0) {
+		Arena* arena = create_Arena(0);
+		ast_set_arena(arena);
+
+		DLL* program = parse_program(stdin);
+		if (!program) {
+			printf("Parsing failed.\n");
+			free_Arena(arena);
+			return -1;
+		}
+
+		FuzzReport report;
+		fuzz_program(program, opts.jobs, fuzz_seconds, &report);
+		print_fuzz_report(&report);
+
+		int failed = report.nfailures > 0;
+		free_FuzzReport(&report);
+		free_Arena(arena);
+		return failed ? 1 : 0;
+	}
 
-	// Build ¬VC (negation of VC)
-	Z3_ast not_vc = Z3_mk_not(ctx, res);
-	Z3_inc_ref(ctx, not_vc);
+	if (cache_path) opts.cache = load_ProofCache(cache_path);
 
-	// Assert ¬VC (to check validity)
-	
-	Z3_solver_assert(ctx, solver, not_vc); // add constraint not_vc to solver
+	// Arena, solver pool and Z3 contexts are shared by every program of this run
+	Verifier* verifier = create_Verifier(opts);
 
 	// ----------------------------
-	// Check satisfiability
+	// Batch mode: one JSON line per file
 	// ----------------------------
-	Z3_lbool z3_result = Z3_solver_check(ctx, solver); //Run the solver
-	
-	if (z3_result == Z3_L_FALSE) {
-		// UNSAT(¬VC) ⇒ VC is valid
-		printf(GREEN "Z3 says: The program is correct!\n" RESET);
-	} 
-	else if (z3_result == Z3_L_TRUE) {
-		 // SAT(¬VC) ⇒ counterexample exists
-		printf(RED "Z3 says: The program is NOT correct!\n" RESET);
-	} 
-	else {
-		printf("Z3 says: Unknown result.\n");
+	if (batch_from) {
+		int failed = verify_batch(verifier, argv + batch_from, argc - batch_from, stdout);
+		shutdown(verifier);
+		return failed ? 1 : 0;
 	}
 
 	// ----------------------------
-	// Cleanup
+	// Server mode: warm contexts, incremental re-checking
+	// ----------------------------
+	if (server_mode) {
+		Server* server = create_Server(verifier);
+		int status = socket_path ? serve_socket(server, socket_path) : serve_stream(server, stdin, stdout);
+		free_Server(server);
+		shutdown(verifier);
+		return status < 0 ? 1 : 0;
+	}
+
+	// ----------------------------
+	// Single program from stdin
 	// ----------------------------
-	Z3_solver_dec_ref(ctx, solver);
-	Z3_dec_ref(ctx, res);
-	Z3_dec_ref(ctx, not_vc);
-	free_hashmap_with_context(var_cache, ctx);
-	Z3_del_context(ctx);
+	printf("Start parsing...\n");
 
-	// Free ASTs
-	free_ASTNode(vc);
-	free_ASTNode(result);
-	free_DLL(root);
+	VerifyResult res;
+	verify_file(verifier, stdin, &res);
 
-	Z3_finalize_memory();
+	if (res.status == PROGRAM_PARSE_ERROR) {
+		printf("Parsing failed.\n");
+		shutdown(verifier);
+		return -1;
+	}
+	printf("Parsing done.\n");
+	printf("Starting verification...\n");
+
+	if (res.status == PROGRAM_UNSUPPORTED) {
+		printf(RED "ERROR -> \"PRECONDITION: true\" is not supported\n" RESET);
+		shutdown(verifier);
+		return 1;
+	}
+
+	print_report(&res, opts.jobs, opts.solver.portfolio);
+
+	// ----------------------------
+	// Cleanup
+	// ----------------------------
+	verifier_release(verifier, &res);
+	shutdown(verifier); // ASTs (program, VC and all intermediates) go with its arena
 
 	return 0;
 }
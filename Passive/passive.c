@@ -0,0 +1,241 @@
+#include "passive.h"
+#include "hoare.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------
+	Passive VC generation (--vcgen passive)
+	hoare_IfElseRule copies the postcondition into both branches, so k
+	if/else statements in sequence give a VC with 2^k copies of it.
+	Here the program is run forwards once instead:
+		- assignments update a substitution env (as in
+		  hoare_AssignmentBlock): x := E binds x to E[env];
+		- after an if/else, each variable whose value differs between
+		  the branches gets a fresh name x#k, defined by the assumption
+			(B -> x#k == value in then) ∧ (¬B -> x#k == value in else)
+		  and env binds x to x#k;
+		- a loop contributes its own checks (entry, preservation, variant),
+		  built by hoare_WhileRule; each variable it assigns gets a
+		  fresh name, and I ∧ ¬B over those is assumed for what
+		  follows it.
+	The result nests what must be checked under what has been assumed:
+		checks1 ∧ (A1 -> checks2 ∧ (A2 -> ... -> post[env]))
+	The postcondition appears once, and the VC is linear in the size
+	of the program. Fresh names are implicitly universally quantified;
+	those of an if/else are fixed by their definition, so for loop-free
+	code the VC is valid exactly when the one of hoare_prover is. Those
+	of a loop are unconstrained but for I ∧ ¬B: what follows the loop
+	is checked for every state its exit allows, as the exit obligation
+	of hoare_WhileRule does with its own x@k names.
+   ------------------------------------------------------------------ */
+
+// One point of a block: what must hold there, then what holds after it
+typedef struct {
+	ASTNode* checks;		// NULL: nothing to check
+	ASTNode* assumption;	// NULL: nothing learned
+	const char* label;		// names what follows the assumption (or NULL)
+} Step;
+
+typedef struct {
+	Step* steps;
+	int count;
+	int capacity;
+} Block;
+
+static void gen_block(DLL* code, SubstEnv* env, Block* block, int* fresh);
+
+
+static void add_step(Block* block, ASTNode* checks, ASTNode* assumption, const char* label) {
+	if (!checks && !assumption) return;
+
+	if (block->count == block->capacity) {
+		block->capacity = block->capacity ? 2 * block->capacity : 8;
+		block->steps = realloc(block->steps, block->capacity * sizeof(Step));
+		if (!block->steps) { perror("realloc"); exit(1); }
+	}
+	block->steps[block->count++] = (Step){ checks, assumption, label };
+}
+
+static ASTNode* conjoin(ASTNode* a, ASTNode* b) {
+	if (!a) return b;
+	if (!b) return a;
+	return create_node_binary(OP_AND, a, b);
+}
+
+// checks1 ∧ (A1 -> checks2 ∧ (A2 -> ... -> final))
+static ASTNode* nest(const Block* block, ASTNode* final) {
+	ASTNode* acc = final;
+	for (int i = block->count - 1; i >= 0; i--) {
+		const Step* step = &block->steps[i];
+		if (step->assumption && !is_node_true(acc)) {
+			acc = create_node_binary(OP_IMPLY, step->assumption, acc);
+			if (step->label) acc = create_node_label(step->label, acc);
+		}
+		if (step->checks) acc = is_node_true(acc) ? step->checks : create_node_binary(OP_AND, step->checks, acc);
+	}
+	return acc;
+}
+
+// Everything a block assumes, as one conjunction (NULL if nothing)
+static ASTNode* assumptions(const Block* block) {
+	ASTNode* acc = NULL;
+	for (int i = 0; i < block->count; i++) {
+		if (block->steps[i].assumption) acc = conjoin(acc, block->steps[i].assumption);
+	}
+	return acc;
+}
+
+// Value of x in env (x itself if it was never assigned)
+static ASTNode* value_of(const SubstEnv* env, int x) {
+	ASTNode* term = subst_env_lookup(env, x);
+	return term ? term : create_node_symbol(x);
+}
+
+// By name, not by symbol number: fresh names must not depend on the
+// order in which identifiers were first interned
+static int compare_names(const void* a, const void* b) {
+	return strcmp(symbol_name(*(const int*)a), symbol_name(*(const int*)b));
+}
+
+// Symbols bound in either env, sorted by name, without duplicates (malloc'd)
+static int* assigned_names(const SubstEnv* a, const SubstEnv* b, int* count) {
+	int* names = malloc((a->count + b->count + 1) * sizeof(int));
+	if (!names) { perror("malloc"); exit(1); }
+
+	int n = 0;
+	for (int i = 0; i < a->capacity; i++) if (a->syms[i]) names[n++] = a->syms[i];
+	for (int i = 0; i < b->capacity; i++) if (b->syms[i]) names[n++] = b->syms[i];
+	qsort(names, n, sizeof(int), compare_names);
+
+	int kept = 0;
+	for (int i = 0; i < n; i++) {
+		if (kept == 0 || names[kept - 1] != names[i]) names[kept++] = names[i];
+	}
+	*count = kept;
+	return names;
+}
+
+// Fresh variable x#k
+static ASTNode* fresh_id(int x, int* fresh) {
+	return create_node_fresh(x, '#', ++*fresh);
+}
+
+static void gen_if(ASTNode* node, SubstEnv* env, Block* block, int* fresh) {
+	ASTNode* condition = substitute_env(node->If.condition, env);
+	ASTNode* not_condition = create_node_unary(OP_NOT, condition);
+
+	SubstEnv* env_then = copy_SubstEnv(env);
+	SubstEnv* env_else = copy_SubstEnv(env);
+	Block then_block = { NULL, 0, 0 };
+	Block else_block = { NULL, 0, 0 };
+	gen_block(node->If.block_if, env_then, &then_block, fresh);
+	gen_block(node->If.block_else, env_else, &else_block, fresh);
+
+	// Checks inside the branches, under the branch condition
+	ASTNode* checks = NULL;
+	ASTNode* then_checks = nest(&then_block, create_node_bool(1));
+	ASTNode* else_checks = nest(&else_block, create_node_bool(1));
+	if (!is_node_true(then_checks)) {
+		checks = create_node_label(rule_label("if", node->If.condition, "then-branch"),
+			create_node_binary(OP_IMPLY, condition, then_checks));
+	}
+	if (!is_node_true(else_checks)) {
+		checks = conjoin(checks, create_node_label(rule_label("if", node->If.condition, "else-branch"),
+			create_node_binary(OP_IMPLY, not_condition, else_checks)));
+	}
+
+	// Merge: a fresh name for every variable the branches disagree on
+	ASTNode* then_facts = assumptions(&then_block);
+	ASTNode* else_facts = assumptions(&else_block);
+	int count;
+	int* names = assigned_names(env_then, env_else, &count);
+
+	for (int i = 0; i < count; i++) {
+		ASTNode* v_then = value_of(env_then, names[i]);
+		ASTNode* v_else = value_of(env_else, names[i]);
+		if (v_then == v_else) {
+			subst_env_bind(env, names[i], v_then);
+			continue;
+		}
+
+		ASTNode* x = fresh_id(names[i], fresh);
+		then_facts = conjoin(then_facts, create_node_binary(OP_EQ, x, v_then));
+		else_facts = conjoin(else_facts, create_node_binary(OP_EQ, x, v_else));
+		subst_env_bind(env, names[i], x);
+	}
+
+	ASTNode* assumption = NULL;
+	if (then_facts || else_facts) {
+		assumption = create_node_binary(OP_AND,
+			create_node_binary(OP_IMPLY, condition, then_facts ? then_facts : create_node_bool(1)),
+			create_node_binary(OP_IMPLY, not_condition, else_facts ? else_facts : create_node_bool(1)));
+	}
+	add_step(block, checks, assumption, NULL);
+
+	free(names);
+	free(then_block.steps);
+	free(else_block.steps);
+	free_SubstEnv(env_then);
+	free_SubstEnv(env_else);
+}
+
+static void gen_while(ASTNode* node, SubstEnv* env, Block* block, int* fresh) {
+	// Entry, preservation and variant checks: the loop rule with nothing
+	// to prove on exit, evaluated in the current state
+	ASTNode* checks = substitute_env(hoare_WhileRule(node, create_node_bool(1)), env);
+
+	// After any number of iterations, what the loop assigns is unknown
+	int* assigned;
+	int count = block_assigned(node->While.block_main, &assigned);
+	for (int i = 0; i < count; i++) subst_env_bind(env, assigned[i], fresh_id(assigned[i], fresh));
+	free(assigned);
+
+	ASTNode* after = create_node_binary(OP_AND,
+		node->While.invariant,
+		create_node_unary(OP_NOT, node->While.condition));
+
+	add_step(block, checks, substitute_env(after, env), rule_label("while", node->While.condition, "exit"));
+}
+
+static void gen_block(DLL* code, SubstEnv* env, Block* block, int* fresh) {
+	if (!code) return;
+
+	for (int i = 0; i < code->count; i++) {
+		ASTNode* node = code->stmts[i];
+		switch (node->type) {
+			case NODE_ASSIGN:
+				subst_env_bind(env, node->Assign.sym, substitute_env(node->Assign.expr, env));
+				break;
+			case NODE_IF_ELSE:
+				gen_if(node, env, block, fresh);
+				break;
+			case NODE_WHILE:
+				gen_while(node, env, block, fresh);
+				break;
+			default:
+				fprintf(stderr, "passive_wp: unsupported node type %d\n", node->type);
+				break;
+		}
+	}
+}
+
+// The VC of hoare_prover(code, post), built so that it is linear in the
+// size of the program (see above). Allocates from the AST arena.
+ASTNode* passive_wp(DLL* code, ASTNode* post) {
+	if (!code || !post) {
+		fprintf(stderr, RED "NULL input to passive_wp\n" RESET);
+		return NULL;
+	}
+
+	SubstEnv* env = create_SubstEnv();
+	Block block = { NULL, 0, 0 };
+	int fresh = 0;
+
+	gen_block(code, env, &block, &fresh);
+	ASTNode* wp = nest(&block, substitute_env(post, env));
+
+	free(block.steps);
+	free_SubstEnv(env);
+	return wp;
+}
@@ -0,0 +1,8 @@
+#ifndef PASSIVE_H
+#define PASSIVE_H
+
+#include "ast.h"
+
+ASTNode* passive_wp(DLL* code, ASTNode* post);
+
+#endif
@@ -0,0 +1,302 @@
+#include "server.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVER_MAX_REQUEST	(64 << 20)	// bytes of program text per VERIFY
+
+/* ------------------------------------------------------------------
+	Verification server
+	A long-running process keeps one Verifier (and so its Z3 contexts)
+	warm and answers requests read from a stream:
+
+		VERIFY <name> <nbytes>\n<nbytes of program text>
+		FORGET <name>
+		QUIT
+
+	Each VERIFY is answered by one JSON line with the program's result
+	and the verdict of every obligation. For each file name the server
+	remembers the obligations of the previous request by formula text;
+	an obligation whose text did not change reuses its old verdict, so
+	an edit only re-checks the obligations it actually affected. Only
+	valid and invalid verdicts are remembered: unknown (a timeout, a
+	resource limit) and error are retried by the next request.
+
+	<nbytes> must be plain decimal digits; a program text longer than
+	SERVER_MAX_REQUEST is skipped with an error reply, before anything
+	is allocated for it.
+   ------------------------------------------------------------------ */
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+Server* create_Server(Verifier* v) {
+	Server* server = malloc(sizeof(Server));
+	if (!server) { perror("malloc"); exit(1); }
+
+	server->verifier = v;
+	server->files = NULL;
+	server->nfiles = 0;
+	server->capacity = 0;
+	return server;
+}
+
+static void clear_FileCache(FileCache* file) {
+	for (int i = 0; i < file->count; i++) {
+		free(file->entries[i].text);
+		free(file->entries[i].model);
+	}
+	free(file->entries);
+	file->entries = NULL;
+	file->count = 0;
+}
+
+// Cache of a file name, created empty on first use
+static FileCache* find_file(Server* server, const char* name) {
+	for (int i = 0; i < server->nfiles; i++) {
+		if (strcmp(server->files[i].name, name) == 0) return &server->files[i];
+	}
+
+	if (server->nfiles == server->capacity) {
+		server->capacity = server->capacity ? 2 * server->capacity : 8;
+		server->files = realloc(server->files, server->capacity * sizeof(FileCache));
+		if (!server->files) { perror("realloc"); exit(1); }
+	}
+
+	FileCache* file = &server->files[server->nfiles++];
+	file->name = strdup(name);
+	file->entries = NULL;
+	file->count = 0;
+	return file;
+}
+
+static void forget_file(Server* server, const char* name) {
+	for (int i = 0; i < server->nfiles; i++) {
+		if (strcmp(server->files[i].name, name) != 0) continue;
+
+		clear_FileCache(&server->files[i]);
+		free(server->files[i].name);
+		server->files[i] = server->files[--server->nfiles];
+		return;
+	}
+}
+
+static int compare_entries(const void* a, const void* b) {
+	return strcmp(((const CachedVerdict*)a)->text, ((const CachedVerdict*)b)->text);
+}
+
+static CachedVerdict* lookup_entry(FileCache* file, const char* text) {
+	if (file->count == 0) return NULL;
+	CachedVerdict key = { (char*)text, VERDICT_UNKNOWN, NULL };
+	return bsearch(&key, file->entries, file->count, sizeof(CachedVerdict), compare_entries);
+}
+
+// Handle one VERIFY request whose program text is `text` (len bytes)
+static void handle_verify(Server* server, const char* name, char* text, size_t len, FILE* out) {
+	Verifier* v = server->verifier;
+	FileCache* file = find_file(server, name);
+	double start = now_ms();
+
+	FILE* in = fmemopen(text, len, "r");
+	if (!in) { perror("fmemopen"); exit(1); }
+
+	VerifyResult res;
+	verify_prepare(v, in, &res);
+	fclose(in);
+
+	int count = res.obligations ? res.obligations->count : 0;
+	int rechecked = 0;
+	char** texts = NULL;
+
+	if (res.obligations) {
+		// Reuse the verdicts of obligations that did not change
+		char* known = calloc(count ? count : 1, 1);
+		texts = malloc((count ? count : 1) * sizeof(char*));
+		if (!known || !texts) { perror("malloc"); exit(1); }
+
+		for (int i = 0; i < count; i++) {
+			texts[i] = formula_to_string(res.obligations->items[i].formula);
+			CachedVerdict* hit = lookup_entry(file, texts[i]);
+			if (!hit) { rechecked++; continue; }
+
+			known[i] = 1;
+			res.results[i].verdict = hit->verdict;
+			res.results[i].model = hit->model ? strdup(hit->model) : NULL;
+		}
+
+		verify_solve(v, &res, known);
+		free(known);
+
+		// The current version replaces the previous one (definite verdicts
+		// only, as in proof_cache_store)
+		clear_FileCache(file);
+		file->entries = malloc((count ? count : 1) * sizeof(CachedVerdict));
+		if (!file->entries) { perror("malloc"); exit(1); }
+		for (int i = 0; i < count; i++) {
+			if (res.results[i].verdict != VERDICT_VALID && res.results[i].verdict != VERDICT_INVALID) continue;
+			CachedVerdict* e = &file->entries[file->count++];
+			e->text = strdup(texts[i]);
+			e->verdict = res.results[i].verdict;
+			e->model = res.results[i].model ? strdup(res.results[i].model) : NULL;
+		}
+		qsort(file->entries, file->count, sizeof(CachedVerdict), compare_entries);
+	}
+
+	// ----------------------------
+	// Response: one JSON line
+	// ----------------------------
+	fprintf(out, "{\"file\": ");
+	fprint_json_string(out, name);
+	fprintf(out, ", \"result\": \"%s\"", program_status_to_string(res.status));
+
+	if (res.obligations) {
+		fprintf(out, ", \"obligations\": [");
+		for (int i = 0; i < count; i++) {
+			if (i > 0) fprintf(out, ", ");
+			fprintf(out, "{\"label\": ");
+			fprint_json_string(out, res.obligations->items[i].label);
+			fprintf(out, ", \"verdict\": \"%s\"", verdict_to_string(res.results[i].verdict));
+			if (res.results[i].model) {
+				fprintf(out, ", \"counterexample\": ");
+				fprint_json_string(out, res.results[i].model);
+			}
+			if (res.results[i].reason) {
+				fprintf(out, ", \"reason\": ");
+				fprint_json_string(out, res.results[i].reason);
+			}
+			fprintf(out, "}");
+		}
+		fprintf(out, "], \"rechecked\": %d, \"reused\": %d", rechecked, count - rechecked);
+	}
+	fprint_prescreen_json(out, &res);
+	fprintf(out, ", \"ms\": %.3f}\n", now_ms() - start);
+	fflush(out);
+
+	free(texts);
+	verifier_release(v, &res);
+}
+
+// Read and drop len bytes of `in`; 0 if the input ends first
+static int skip_bytes(FILE* in, unsigned long long len) {
+	char buf[4096];
+	while (len > 0) {
+		size_t n = fread(buf, 1, len < sizeof(buf) ? len : sizeof(buf), in);
+		if (n == 0) return 0;
+		len -= n;
+	}
+	return 1;
+}
+
+// Answer requests from `in` until end of input or QUIT. Returns 1 on QUIT.
+int serve_stream(Server* server, FILE* in, FILE* out) {
+	char line[1024];
+
+	while (fgets(line, sizeof(line), in)) {
+		char name[512];
+		char size[20];		// up to 19 digits: fits an unsigned long long
+		char extra;
+		int fields = sscanf(line, "VERIFY %511s %19s %c", name, size, &extra);
+
+		if (fields >= 2) {
+			// The size comes from the client. Without it the text cannot
+			// be found in the stream, so a malformed one ends the stream
+			// (%zu would have read "-1" as SIZE_MAX)
+			if (fields > 2 || size[strspn(size, "0123456789")] != '\0') {
+				fprintf(out, "{\"error\": \"bad program size\"}\n");
+				fflush(out);
+				return 0;
+			}
+			unsigned long long len = strtoull(size, NULL, 10);
+
+			// Too big is an error reply, not a reason to exit
+			char* text = len <= SERVER_MAX_REQUEST ? malloc(len + 1) : NULL;
+			if (!text) {
+				fprintf(out, "{\"error\": \"program text too large\"}\n");
+				fflush(out);
+				if (!skip_bytes(in, len)) return 0;
+				continue;
+			}
+
+			if (fread(text, 1, len, in) != len) {
+				fprintf(out, "{\"error\": \"truncated program text\"}\n");
+				fflush(out);
+				free(text);
+				return 0;
+			}
+			text[len] = '\0';
+
+			handle_verify(server, name, text, len, out);
+			free(text);
+		} else if (sscanf(line, "FORGET %511s", name) == 1) {
+			forget_file(server, name);
+			fprintf(out, "{\"forgotten\": ");
+			fprint_json_string(out, name);
+			fprintf(out, "}\n");
+			fflush(out);
+		} else if (strncmp(line, "QUIT", 4) == 0) {
+			return 1;
+		} else if (line[0] != '\n') {
+			fprintf(out, "{\"error\": \"bad request\"}\n");
+			fflush(out);
+		}
+	}
+	return 0;
+}
+
+// Listen on a Unix socket; clients are served one at a time until QUIT
+int serve_socket(Server* server, const char* path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) { perror("socket"); return -1; }
+
+	unlink(path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	int quit = 0;
+	while (!quit) {
+		int client = accept(fd, NULL, NULL);
+		if (client < 0) { perror("accept"); break; }
+
+		FILE* in = fdopen(client, "r");
+		FILE* out = fdopen(dup(client), "w");
+		if (!in || !out) { perror("fdopen"); exit(1); }
+
+		quit = serve_stream(server, in, out);
+
+		fclose(in);
+		fclose(out);
+	}
+
+	close(fd);
+	unlink(path);
+	return 0;
+}
+
+void free_Server(Server* server) {
+	if (!server) return;
+
+	for (int i = 0; i < server->nfiles; i++) {
+		clear_FileCache(&server->files[i]);
+		free(server->files[i].name);
+	}
+	free(server->files);
+	free(server);
+}
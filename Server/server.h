@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include "verifier.h"
+
+// Verdict of one obligation from the last request for a file, keyed by
+// the obligation's formula text (all strings malloc'd).
+typedef struct CachedVerdict_ {
+	char* text;
+	Verdict verdict;
+	char* model;
+} CachedVerdict;
+
+// Obligations of the last version of one file, sorted by text
+typedef struct FileCache_ {
+	char* name;
+	CachedVerdict* entries;
+	int count;
+} FileCache;
+
+typedef struct Server_ {
+	Verifier* verifier;
+	FileCache* files;
+	int nfiles;
+	int capacity;
+} Server;
+
+
+Server* create_Server(Verifier* v);
+int serve_stream(Server* server, FILE* in, FILE* out);
+int serve_socket(Server* server, const char* path);
+void free_Server(Server* server);
+
+#endif
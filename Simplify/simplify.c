@@ -0,0 +1,718 @@
+#include "simplify.h"
+#include "hashmap.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------
+	Formula simplification
+	The VCs built by the Hoare rules carry a lot of trivial structure:
+	`true -> P` from empty branches, `i + 1 - 1` after substitution,
+	comparisons between constants, `not not B`. simplify_formula
+	rewrites it away before the VC is split and sent to Z3:
+		- constant folding of + - * / % min max fact and comparisons.
+		  Z3 reads them as unbounded integers with Euclidean division,
+		  so a fold that could disagree (int overflow, / or % with a
+		  negative operand or a zero divisor, fact outside 0..12) is
+		  left to Z3;
+		- boolean identities and absorption: true ∧ P = P, P ∨ P = P,
+		  P ∧ (P ∨ Q) = P, P ∧ ¬P = false, false -> P = true,
+		  not not B = B, not (a < b) = a >= b, ...;
+		- linear normalization: a sum is rewritten c1*t1 + ... + k with
+		  its terms in a fixed order and like terms collected, so
+		  i + 1 - 1 = i and (n - i) - (n - (i + 1)) = 1; a comparison
+		  whose sides differ by a constant is decided;
+		- ite(c, a, b) with a constant condition or equal branches.
+	Labels are kept (one whose child becomes true disappears with it).
+	Results are memoized by node, so a shared subterm is simplified
+	once and stays shared; sums are linearized as DAGs (see linearize).
+   ------------------------------------------------------------------ */
+
+#define SIZE_CAP 4096	// term_size stops counting here
+
+typedef struct {
+	ASTNode* term;			// the non-constant factor (id, product, call, ...)
+	long long coef;
+} Monomial;
+
+// sum(coef_i * term_i) + constant
+typedef struct {
+	Monomial* items;
+	int count;
+	int capacity;
+	long long constant;
+	int overflow;			// a coefficient left the int range: give up
+} LinearForm;
+
+// State of one simplify_formula call
+typedef struct {
+	PtrMap* memo;			// node -> its simplified form
+	WorkStack missing;		// operands a rule needed before they were simplified
+} Simplifier;
+
+// Simplified form of node; NULL if it is not known yet, in which case
+// node is recorded as missing and the rule asking for it is retried later
+static ASTNode* simplified(Simplifier* S, ASTNode* node) {
+	ASTNode* res = ptrmap_get(S->memo, node);
+	if (!res) *(ASTNode**)work_push(&S->missing) = node;
+	return res;
+}
+
+
+// Order of two nodes by their own content (not their children)
+static int compare_heads(const ASTNode* a, const ASTNode* b) {
+	if (a == b) return 0;
+	if (!a || !b) return a ? 1 : -1;
+	if (a->type != b->type) return a->type < b->type ? -1 : 1;
+
+	switch (a->type) {
+		case NODE_NUMBER:	return (a->number > b->number) - (a->number < b->number);
+		case NODE_ID:		return a->id_sym == b->id_sym ? 0 : strcmp(a->id_name, b->id_name);
+		case NODE_BOOL:		return a->bool_value - b->bool_value;
+
+		case NODE_BIN_OP:
+			return a->binary_op.op == b->binary_op.op ? 0 : a->binary_op.op < b->binary_op.op ? -1 : 1;
+		case NODE_UNARY_OP:
+			return a->unary_op.op == b->unary_op.op ? 0 : a->unary_op.op < b->unary_op.op ? -1 : 1;
+		case NODE_FUNCTION:
+			return a->function.func == b->function.func ? 0 : a->function.func < b->function.func ? -1 : 1;
+		case NODE_LABEL:
+			return strcmp(a->label.text, b->label.text);
+		case NODE_ITE:
+			return 0;
+		case NODE_NARY:
+			if (a->nary.op != b->nary.op) return a->nary.op < b->nary.op ? -1 : 1;
+			return (a->nary.count > b->nary.count) - (a->nary.count < b->nary.count);
+
+		default:			// statements: only equal to themselves
+			return a < b ? -1 : 1;
+	}
+}
+
+// Total order on terms, 0 iff they are the same term (structurally):
+// the first difference in a left-to-right walk of both terms
+static int compare_terms(const ASTNode* a, const ASTNode* b) {
+	typedef struct { const ASTNode* a; const ASTNode* b; } TermPair;
+
+	int c = compare_heads(a, b);
+	if (c || a == b || child_count(a) == 0) return c;
+
+	WorkStack stack;
+	work_init(&stack, sizeof(TermPair));
+	*(TermPair*)work_push(&stack) = (TermPair){ a, b };
+
+	TermPair* top;
+	while (!c && (top = work_pop(&stack)) != NULL) {
+		TermPair pair = *top;
+		c = compare_heads(pair.a, pair.b);
+		if (c || pair.a == pair.b) continue;
+
+		// Same head, hence the same number of children
+		for (int i = child_count(pair.a) - 1; i >= 0; i--) {
+			*(TermPair*)work_push(&stack) = (TermPair){
+				*child_slot((ASTNode*)pair.a, i), *child_slot((ASTNode*)pair.b, i) };
+		}
+	}
+
+	work_free(&stack);
+	return c;
+}
+
+static int same_term(const ASTNode* a, const ASTNode* b) {
+	return compare_terms(a, b) == 0;
+}
+
+static int is_bool(const ASTNode* node, int value) {
+	return node->type == NODE_BOOL && node->bool_value == value;
+}
+
+static int is_number(const ASTNode* node) {
+	return node->type == NODE_NUMBER;
+}
+
+static int is_comparison(OpCode op) {
+	return op == OP_LT || op == OP_GT || op == OP_LE || op == OP_GE || op == OP_EQ || op == OP_NEQ;
+}
+
+// a and b are B and not B (either way round)
+static int complementary(const ASTNode* a, const ASTNode* b) {
+	if (a->type == NODE_UNARY_OP && a->unary_op.op == OP_NOT && same_term(a->unary_op.child, b)) return 1;
+	if (b->type == NODE_UNARY_OP && b->unary_op.op == OP_NOT && same_term(b->unary_op.child, a)) return 1;
+	return 0;
+}
+
+// `node` is `op`(x, y) with x or y equal to `term`
+static int has_operand(const ASTNode* node, OpCode op, const ASTNode* term) {
+	return node->type == NODE_BIN_OP && node->binary_op.op == op
+		&& (same_term(node->binary_op.left, term) || same_term(node->binary_op.right, term));
+}
+
+// Number of nodes of a term as a tree, up to budget
+static int term_size(const ASTNode* node, int budget) {
+	WorkStack stack;
+	work_init(&stack, sizeof(const ASTNode*));
+	*(const ASTNode**)work_push(&stack) = node;
+
+	int size = 0;
+	const ASTNode** top;
+	while (size < budget && (top = work_pop(&stack)) != NULL) {
+		const ASTNode* n = *top;
+		if (!n) continue;
+		size++;
+		for (int i = child_count(n) - 1; i >= 0; i--) {
+			*(const ASTNode**)work_push(&stack) = *child_slot((ASTNode*)n, i);
+		}
+	}
+
+	work_free(&stack);
+	return size;
+}
+
+// `node` itself if its operands did not change, otherwise a new node
+static ASTNode* rebuild_binary(ASTNode* node, ASTNode* left, ASTNode* right) {
+	if (left == node->binary_op.left && right == node->binary_op.right) return node;
+	return create_node_binary(node->binary_op.op, left, right);
+}
+
+
+/* ---------------- constant folding ---------------- */
+
+// a op b as Z3 computes it; 0 if the result is not certain to agree
+static int fold_arith(OpCode op, int a, int b, int* out) {
+	switch (op) {
+		case OP_ADD:	return !__builtin_add_overflow(a, b, out);
+		case OP_SUB:	return !__builtin_sub_overflow(a, b, out);
+		case OP_MUL:	return !__builtin_mul_overflow(a, b, out);
+
+		// C truncates, Z3 rounds towards -inf for a positive divisor:
+		// they agree on non-negative operands only
+		case OP_DIV:
+			if (a < 0 || b <= 0) return 0;
+			*out = a / b;
+			return 1;
+		case OP_MOD:
+			if (a < 0 || b <= 0) return 0;
+			*out = a % b;
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+static int fold_compare(OpCode op, long long a, long long b) {
+	switch (op) {
+		case OP_LT:		return a < b;
+		case OP_GT:		return a > b;
+		case OP_LE:		return a <= b;
+		case OP_GE:		return a >= b;
+		case OP_EQ:		return a == b;
+		case OP_NEQ:	return a != b;
+		default:		return 0;
+	}
+}
+
+static OpCode negate_comparison(OpCode op) {
+	switch (op) {
+		case OP_LT:		return OP_GE;
+		case OP_GT:		return OP_LE;
+		case OP_LE:		return OP_GT;
+		case OP_GE:		return OP_LT;
+		case OP_EQ:		return OP_NEQ;
+		default:		return OP_EQ;	// OP_NEQ
+	}
+}
+
+
+/* ---------------- linear forms ---------------- */
+
+static int fits_int(long long v) {
+	return v > INT_MIN && v <= INT_MAX;		// INT_MIN excluded: it is negated when printed
+}
+
+static void lf_add_constant(LinearForm* lf, long long v) {
+	if (__builtin_add_overflow(lf->constant, v, &lf->constant)) lf->overflow = 1;
+}
+
+static void lf_add_term(LinearForm* lf, ASTNode* term, long long coef) {
+	if (lf->count == lf->capacity) {
+		lf->capacity = lf->capacity ? 2 * lf->capacity : 8;
+		lf->items = realloc(lf->items, lf->capacity * sizeof(Monomial));
+		if (!lf->items) { perror("realloc"); exit(1); }
+	}
+	lf->items[lf->count].term = term;
+	lf->items[lf->count].coef = coef;
+	lf->count++;
+}
+
+/* A sum is read as a DAG rather than a tree: `x = x + x` repeated k
+   times gives a term of 2^k leaves over k + 1 distinct nodes. Walking
+   it from the root (a + b -> a, b; a - b -> a, -b; k * t -> t scaled
+   by k) the coefficient of a node is the sum, over every path from
+   the root, of the product of the scales on the path. The nodes are
+   first collected with the number of edges into each; coefficients
+   are then pushed down in topological order (a node is complete once
+   all its incoming edges are counted), so each distinct node is
+   visited once. */
+
+// Edges of the walk out of `node`: its operands and their scales (0: a leaf).
+// Operands of * and atoms must be simplified already (see simplified).
+static int sum_operands(ASTNode* node, ASTNode* ops[2], long long scales[2], Simplifier* S) {
+	if (node->type == NODE_NUMBER) return 0;
+
+	if (node->type == NODE_BIN_OP) {
+		switch (node->binary_op.op) {
+			case OP_ADD:
+			case OP_SUB:
+				ops[0] = node->binary_op.left;
+				ops[1] = node->binary_op.right;
+				scales[0] = 1;
+				scales[1] = node->binary_op.op == OP_ADD ? 1 : -1;
+				return 2;
+
+			case OP_MUL: {
+				ASTNode* left = simplified(S, node->binary_op.left);
+				ASTNode* right = simplified(S, node->binary_op.right);
+				if (!left || !right || (!is_number(left) && !is_number(right))) return 0;
+				ops[0] = is_number(left) ? right : left;
+				scales[0] = is_number(left) ? left->number : right->number;
+				return 1;
+			}
+
+			default:
+				break;
+		}
+	}
+
+	// Anything else is an atom; its simplified form may still be linear
+	ASTNode* s = simplified(S, node);
+	if (s && s != node && (s->type == NODE_NUMBER
+		|| (s->type == NODE_BIN_OP && (s->binary_op.op == OP_ADD || s->binary_op.op == OP_SUB || s->binary_op.op == OP_MUL)))) {
+		ops[0] = s;
+		scales[0] = 1;
+		return 1;
+	}
+	return 0;
+}
+
+// Add coef * leaf to lf
+static void sum_leaf(ASTNode* node, long long coef, LinearForm* lf, Simplifier* S) {
+	long long v;
+	if (node->type == NODE_NUMBER) {
+		if (__builtin_mul_overflow(coef, (long long)node->number, &v)) lf->overflow = 1;
+		else lf_add_constant(lf, v);
+	} else if (node->type == NODE_BIN_OP && node->binary_op.op == OP_MUL) {
+		// a product without a constant factor
+		lf_add_term(lf, rebuild_binary(node, simplified(S, node->binary_op.left),
+			simplified(S, node->binary_op.right)), coef);
+	} else {
+		lf_add_term(lf, simplified(S, node), coef);
+	}
+}
+
+// A node of the walk: coefficient so far, incoming edges not yet counted
+typedef struct {
+	ASTNode* node;
+	long long coef;
+	int pending;
+} SumNode;
+
+// Add scale * node to lf (see above)
+static void linearize(ASTNode* node, long long scale, LinearForm* lf, Simplifier* S) {
+	if (lf->overflow) return;
+
+	PtrMap* index = create_PtrMap(64);		// node -> 1 + its position in nodes
+	int count = 0, capacity = 16;
+	SumNode* nodes = malloc(capacity * sizeof(SumNode));
+	if (!nodes) { perror("malloc"); exit(1); }
+
+	WorkStack stack;
+	work_init(&stack, sizeof(int));
+	ASTNode* ops[2];
+	long long scales[2];
+
+	// Pass 1: every node reachable through sums, with its number of incoming edges
+	nodes[count++] = (SumNode){ node, 0, 0 };
+	ptrmap_put(index, node, (void*)(uintptr_t)count);
+	*(int*)work_push(&stack) = 0;
+
+	int* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		int n = sum_operands(nodes[*top].node, ops, scales, S);
+		for (int i = 0; i < n; i++) {
+			uintptr_t j = (uintptr_t)ptrmap_get(index, ops[i]);
+			if (j) {
+				nodes[j - 1].pending++;
+				continue;
+			}
+			if (count == capacity) {
+				capacity *= 2;
+				nodes = realloc(nodes, capacity * sizeof(SumNode));
+				if (!nodes) { perror("realloc"); exit(1); }
+			}
+			nodes[count++] = (SumNode){ ops[i], 0, 1 };
+			ptrmap_put(index, ops[i], (void*)(uintptr_t)count);
+			*(int*)work_push(&stack) = count - 1;
+		}
+	}
+
+	// Pass 2: coefficients pushed from the root down, in topological order
+	// (not if an operand is missing: the caller is retried)
+	nodes[0].coef = scale;
+	if (!S->missing.count) *(int*)work_push(&stack) = 0;
+	while (!lf->overflow && (top = work_pop(&stack)) != NULL) {
+		SumNode* cur = &nodes[*top];
+		int n = sum_operands(cur->node, ops, scales, S);
+		if (n == 0) sum_leaf(cur->node, cur->coef, lf, S);
+
+		for (int i = 0; i < n; i++) {
+			SumNode* next = &nodes[(uintptr_t)ptrmap_get(index, ops[i]) - 1];
+			long long k;
+			if (__builtin_mul_overflow(cur->coef, scales[i], &k)
+				|| __builtin_add_overflow(next->coef, k, &next->coef)) {
+				lf->overflow = 1;
+				break;
+			}
+			if (--next->pending == 0) *(int*)work_push(&stack) = (int)(next - nodes);
+		}
+	}
+
+	work_free(&stack);
+	free(nodes);
+	free_PtrMap(index);
+}
+
+static int compare_monomials(const void* a, const void* b) {
+	return compare_terms(((const Monomial*)a)->term, ((const Monomial*)b)->term);
+}
+
+// Sort the terms and collect like terms; drops zero coefficients
+static void lf_normalize(LinearForm* lf) {
+	if (lf->overflow || lf->count == 0) return;
+
+	qsort(lf->items, lf->count, sizeof(Monomial), compare_monomials);
+
+	int n = 0;
+	for (int i = 0; i < lf->count; i++) {
+		if (n > 0 && same_term(lf->items[n - 1].term, lf->items[i].term)) {
+			if (__builtin_add_overflow(lf->items[n - 1].coef, lf->items[i].coef, &lf->items[n - 1].coef)) {
+				lf->overflow = 1;
+				return;
+			}
+		} else {
+			lf->items[n++] = lf->items[i];
+		}
+	}
+
+	int kept = 0;
+	for (int i = 0; i < n; i++) {
+		if (lf->items[i].coef != 0) lf->items[kept++] = lf->items[i];
+	}
+	lf->count = kept;
+}
+
+static int lf_fits_int(const LinearForm* lf) {
+	if (lf->overflow || !fits_int(lf->constant)) return 0;
+	for (int i = 0; i < lf->count; i++) {
+		if (!fits_int(lf->items[i].coef)) return 0;
+	}
+	return 1;
+}
+
+// |coef| * term
+static ASTNode* build_monomial(const Monomial* m) {
+	long long k = m->coef < 0 ? -m->coef : m->coef;
+	if (k == 1) return m->term;
+	return create_node_binary(OP_MUL, create_node_number((int)k), m->term);
+}
+
+// Terms with a coefficient of sign `sign` (+1 or -1), as a sum of |coef| * term,
+// followed by the constant if it has that sign too. NULL if there are none.
+static ASTNode* build_part(const LinearForm* lf, int sign, int with_constant) {
+	ASTNode* sum = NULL;
+	for (int i = 0; i < lf->count; i++) {
+		if ((lf->items[i].coef > 0) != (sign > 0)) continue;
+		ASTNode* m = build_monomial(&lf->items[i]);
+		sum = sum ? create_node_binary(OP_ADD, sum, m) : m;
+	}
+
+	long long k = lf->constant * sign;
+	if (with_constant && k > 0) {
+		ASTNode* c = create_node_number((int)k);
+		sum = sum ? create_node_binary(OP_ADD, sum, c) : c;
+	}
+	return sum;
+}
+
+// The sum as one expression: positive terms, then the negative ones
+// subtracted, the constant last (first if no term is positive)
+static ASTNode* build_sum(const LinearForm* lf) {
+	ASTNode* result = build_part(lf, 1, 0);
+
+	if (!result) result = create_node_number((int)lf->constant);
+	else if (lf->constant > 0) result = create_node_binary(OP_ADD, result, create_node_number((int)lf->constant));
+	else if (lf->constant < 0) result = create_node_binary(OP_SUB, result, create_node_number((int)-lf->constant));
+
+	for (int i = 0; i < lf->count; i++) {
+		if (lf->items[i].coef < 0) result = create_node_binary(OP_SUB, result, build_monomial(&lf->items[i]));
+	}
+	return result;
+}
+
+
+/* ---------------- rules ---------------- */
+
+// Arithmetic root (+, -, *): normalize the whole sum
+static ASTNode* simplify_sum(ASTNode* node, Simplifier* S) {
+	LinearForm lf = { NULL, 0, 0, 0, 0 };
+	linearize(node, 1, &lf, S);
+	if (S->missing.count) {
+		free(lf.items);
+		return NULL;
+	}
+	lf_normalize(&lf);
+
+	ASTNode* result = NULL;
+	if (lf_fits_int(&lf)) {
+		result = build_sum(&lf);
+		// Distributing constants may make the term bigger: keep the smaller
+		if (term_size(result, SIZE_CAP) > term_size(node, SIZE_CAP)) result = NULL;
+	}
+	free(lf.items);
+	if (result) return result;
+
+	// Fall back on the operands alone
+	ASTNode* left = simplified(S, node->binary_op.left);
+	ASTNode* right = simplified(S, node->binary_op.right);
+	if (!left || !right) return NULL;
+	int value;
+	if (is_number(left) && is_number(right) && fold_arith(node->binary_op.op, left->number, right->number, &value)) {
+		return create_node_number(value);
+	}
+	return rebuild_binary(node, left, right);
+}
+
+// a op b for a comparison op: decided when a - b is a constant, and
+// terms common to both sides cancel
+static ASTNode* simplify_comparison(ASTNode* node, Simplifier* S) {
+	OpCode op = node->binary_op.op;
+	ASTNode* left = simplified(S, node->binary_op.left);
+	ASTNode* right = simplified(S, node->binary_op.right);
+	if (!left || !right) return NULL;
+
+	LinearForm lf = { NULL, 0, 0, 0, 0 };
+	linearize(left, 1, &lf, S);
+	linearize(right, -1, &lf, S);
+	if (S->missing.count) {
+		free(lf.items);
+		return NULL;
+	}
+	lf_normalize(&lf);
+
+	ASTNode* result = rebuild_binary(node, left, right);
+	if (lf_fits_int(&lf)) {
+		if (lf.count == 0) {
+			result = create_node_bool(fold_compare(op, lf.constant, 0));
+		} else {
+			// positive part op negative part, e.g. i + 1 <= n + 1 => i <= n
+			ASTNode* pos = build_part(&lf, 1, 1);
+			ASTNode* neg = build_part(&lf, -1, 1);
+			ASTNode* cancelled = create_node_binary(op,
+				pos ? pos : create_node_number(0),
+				neg ? neg : create_node_number(0));
+			if (term_size(cancelled, SIZE_CAP) < term_size(result, SIZE_CAP)) result = cancelled;
+		}
+	}
+	free(lf.items);
+	return result;
+}
+
+// not child, pushed into comparisons and double negations
+static ASTNode* simplify_not(ASTNode* node, ASTNode* child) {
+	if (child->type == NODE_BOOL) return create_node_bool(!child->bool_value);
+	if (child->type == NODE_UNARY_OP && child->unary_op.op == OP_NOT) return child->unary_op.child;
+	if (child->type == NODE_BIN_OP && is_comparison(child->binary_op.op)) {
+		return create_node_binary(negate_comparison(child->binary_op.op), child->binary_op.left, child->binary_op.right);
+	}
+	if (node && child == node->unary_op.child) return node;
+	return create_node_unary(OP_NOT, child);
+}
+
+static ASTNode* simplify_and(ASTNode* node, ASTNode* l, ASTNode* r) {
+	if (is_bool(l, 0) || is_bool(r, 0)) return create_node_bool(0);
+	if (is_bool(l, 1)) return r;
+	if (is_bool(r, 1)) return l;
+	if (same_term(l, r)) return l;
+	if (complementary(l, r)) return create_node_bool(0);
+	if (has_operand(r, OP_OR, l)) return l;		// l ∧ (l ∨ q) = l
+	if (has_operand(l, OP_OR, r)) return r;
+	return rebuild_binary(node, l, r);
+}
+
+static ASTNode* simplify_or(ASTNode* node, ASTNode* l, ASTNode* r) {
+	if (is_bool(l, 1) || is_bool(r, 1)) return create_node_bool(1);
+	if (is_bool(l, 0)) return r;
+	if (is_bool(r, 0)) return l;
+	if (same_term(l, r)) return l;
+	if (complementary(l, r)) return create_node_bool(1);
+	if (has_operand(r, OP_AND, l)) return l;		// l ∨ (l ∧ q) = l
+	if (has_operand(l, OP_AND, r)) return r;
+	return rebuild_binary(node, l, r);
+}
+
+static ASTNode* simplify_imply(ASTNode* node, ASTNode* l, ASTNode* r) {
+	if (is_bool(l, 0) || is_bool(r, 1)) return create_node_bool(1);
+	if (is_bool(l, 1)) return r;
+	if (same_term(l, r)) return create_node_bool(1);
+	if (is_bool(r, 0)) return simplify_not(NULL, l);
+	return rebuild_binary(node, l, r);
+}
+
+static ASTNode* simplify_function(ASTNode* node, Simplifier* S) {
+	ASTNode* a1 = simplified(S, node->function.arg1);
+	ASTNode* a2 = node->function.arg2 ? simplified(S, node->function.arg2) : NULL;
+	if (S->missing.count) return NULL;
+
+	switch (node->function.func) {
+		case FUNC_MIN:
+		case FUNC_MAX:
+			if (same_term(a1, a2)) return a1;
+			if (is_number(a1) && is_number(a2)) {
+				int lower = a1->number < a2->number;
+				int min = lower ? a1->number : a2->number;
+				int max = lower ? a2->number : a1->number;
+				return create_node_number(node->function.func == FUNC_MIN ? min : max);
+			}
+			break;
+
+		case FUNC_FACT:
+			// fact(n) = if n == 0 then 1 else n * fact(n - 1): fits an int up to 12
+			if (is_number(a1) && a1->number >= 0 && a1->number <= 12) {
+				int value = 1;
+				for (int i = 2; i <= a1->number; i++) value *= i;
+				return create_node_number(value);
+			}
+			break;
+	}
+
+	if (a1 == node->function.arg1 && a2 == node->function.arg2) return node;
+	return create_node_Func(node->function.func, a1, a2);
+}
+
+static ASTNode* simplify_binary(ASTNode* node, Simplifier* S) {
+	OpCode op = node->binary_op.op;
+
+	if (op == OP_ADD || op == OP_SUB || op == OP_MUL) return simplify_sum(node, S);
+	if (is_comparison(op)) return simplify_comparison(node, S);
+
+	ASTNode* l = simplified(S, node->binary_op.left);
+	ASTNode* r = simplified(S, node->binary_op.right);
+	if (!l || !r) return NULL;
+
+	switch (op) {
+		case OP_AND:	return simplify_and(node, l, r);
+		case OP_OR:		return simplify_or(node, l, r);
+		case OP_IMPLY:	return simplify_imply(node, l, r);
+
+		case OP_DIV:
+		case OP_MOD: {
+			int value;
+			if (is_number(l) && is_number(r) && fold_arith(op, l->number, r->number, &value)) {
+				return create_node_number(value);
+			}
+			if (is_number(r) && r->number == 1) return op == OP_DIV ? l : create_node_number(0);
+			return rebuild_binary(node, l, r);
+		}
+
+		default:
+			return rebuild_binary(node, l, r);
+	}
+}
+
+// ite(true, a, b) = a, ite(false, a, b) = b, ite(c, a, a) = a
+static ASTNode* simplify_ite(ASTNode* node, Simplifier* S) {
+	ASTNode* c = simplified(S, node->ite.condition);
+	ASTNode* a = simplified(S, node->ite.then_term);
+	ASTNode* b = simplified(S, node->ite.else_term);
+	if (!c || !a || !b) return NULL;
+
+	if (is_bool(c, 1)) return a;
+	if (is_bool(c, 0)) return b;
+	if (same_term(a, b)) return a;
+	if (c == node->ite.condition && a == node->ite.then_term && b == node->ite.else_term) return node;
+	return create_node_ite(c, a, b);
+}
+
+// Simplified form of node, or NULL if an operand it needs is missing
+static ASTNode* simplify_node(ASTNode* node, Simplifier* S) {
+	switch (node->type) {
+		case NODE_BIN_OP:
+			return simplify_binary(node, S);
+
+		case NODE_UNARY_OP: {
+			ASTNode* child = simplified(S, node->unary_op.child);
+			if (!child) return NULL;
+			return node->unary_op.op == OP_NOT ? simplify_not(node, child)
+				: child == node->unary_op.child ? node : create_node_unary(node->unary_op.op, child);
+		}
+
+		case NODE_FUNCTION:
+			return simplify_function(node, S);
+
+		case NODE_LABEL: {
+			ASTNode* child = simplified(S, node->label.child);
+			if (!child) return NULL;
+			if (is_bool(child, 1)) return child;
+			if (child == node->label.child) return node;
+			return create_node_label(node->label.text, child);
+		}
+
+		case NODE_ITE:
+			return simplify_ite(node, S);
+
+		default:			// numbers, ids, booleans
+			return node;
+	}
+}
+
+// Simplified copy of a formula (see above); unchanged parts are shared
+// with the input. Allocates from the AST arena.
+// Nodes are taken from a work stack rather than by recursion: a node
+// whose rule finds operands missing goes back on the stack under them,
+// and is simplified again once they are.
+ASTNode* simplify_formula(ASTNode* node) {
+	if (!node) return NULL;
+
+	Simplifier S;
+	S.memo = create_PtrMap(64);
+	work_init(&S.missing, sizeof(ASTNode*));
+
+	WorkStack stack;
+	work_init(&stack, sizeof(ASTNode*));
+	*(ASTNode**)work_push(&stack) = node;
+
+	ASTNode** top;
+	while ((top = work_pop(&stack)) != NULL) {
+		ASTNode* n = *top;
+		if (ptrmap_get(S.memo, n)) continue;
+
+		S.missing.count = 0;
+		ASTNode* res = simplify_node(n, &S);
+		if (S.missing.count) {
+			*(ASTNode**)work_push(&stack) = n;
+			for (size_t i = 0; i < S.missing.count; i++) {
+				*(ASTNode**)work_push(&stack) = ((ASTNode**)S.missing.items)[i];
+			}
+			continue;
+		}
+		ptrmap_put(S.memo, n, res);
+	}
+
+	ASTNode* res = ptrmap_get(S.memo, node);
+	work_free(&stack);
+	work_free(&S.missing);
+	free_PtrMap(S.memo);
+	return res;
+}
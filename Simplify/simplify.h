@@ -0,0 +1,8 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "ast.h"
+
+ASTNode* simplify_formula(ASTNode* node);
+
+#endif
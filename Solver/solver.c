@@ -0,0 +1,599 @@
+#include "solver.h"
+#include "stats.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Work shared by the threads of one solve_obligations call
+typedef struct {
+	ObligationList* obligations;
+	ObligationResult* results;
+	int next;				// next obligation to hand out (atomic)
+	int chunk;				// consecutive obligations taken at once
+} SolveJob;
+
+typedef struct {
+	SolveJob* job;
+	SolverPool* pool;
+	Z3Env** envs;			// this worker's contexts (pool->width of them)
+} Worker;
+
+/* ------------------------------------------------------------------
+	Portfolio
+	Nonlinear obligations can take Z3 a long time with one configuration
+	and no time with another. In portfolio mode every obligation is given
+	to all strategies below at once, each on its own thread and context;
+	the first definitive answer (valid or counterexample) wins and the
+	other checks are cancelled: a racer that has not started its check
+	yet skips it, one already in Z3 is stopped with Z3_interrupt.
+   ------------------------------------------------------------------ */
+typedef struct {
+	const char* name;
+	const char* tactic;		// NULL: the default (combined) solver
+	unsigned seed;			// random_seed of the default solver
+} Strategy;
+
+static const Strategy strategies[] = {
+	{ "default", NULL,    0 },
+	{ "qfnia",   "qfnia", 0 },
+	{ "nlsat",   "nlsat", 0 },
+	{ "seed-7",  NULL,    7 },
+};
+#define PORTFOLIO_SIZE ((int)(sizeof(strategies) / sizeof(strategies[0])))
+
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Contexts are created lazily, on the calling thread (see worker_envs)
+SolverPool* create_SolverPool(int nworkers, SolverConfig config) {
+	SolverPool* pool = malloc(sizeof(SolverPool));
+	if (!pool) { perror("malloc"); exit(1); }
+
+	if (nworkers < 1) nworkers = 1;
+	pool->nworkers = nworkers;
+	pool->width = config.portfolio ? PORTFOLIO_SIZE : 1;
+	pool->config = config;
+	pool->envs = calloc(nworkers * pool->width, sizeof(Z3Env*));
+	if (!pool->envs) { perror("malloc"); exit(1); }
+	return pool;
+}
+
+// Contexts of worker i, created the first time they are needed
+static Z3Env** worker_envs(SolverPool* pool, int i) {
+	Z3Env** envs = &pool->envs[i * pool->width];
+	for (int k = 0; k < pool->width; k++) {
+		if (envs[k]) continue;
+		envs[k] = create_Z3Env();
+
+		// A cancelled tactic raises a "canceled" error instead of returning
+		// unknown: record it (see check_valid) rather than exit
+		if (pool->config.portfolio || pool->config.timeout_ms) Z3_set_error_handler(envs[k]->ctx, NULL);
+	}
+	return envs;
+}
+
+// Render a model as "x = 1, y = -2" over the given variables
+static char* render_model(Z3Env* env, Z3_model model, ASTNode** vars, int nvars) {
+	Z3_context ctx = env->ctx;
+	char* text = NULL;
+	size_t len = 0;
+	FILE* out = open_memstream(&text, &len);
+	if (!out) { perror("open_memstream"); exit(1); }
+
+	for (int i = 0; i < nvars; i++) {
+		Z3_ast value;
+		// completion: variables the model leaves free get a default value
+		if (!Z3_model_eval(ctx, model, ast_to_z3(env, vars[i]), true, &value)) continue;
+		Z3_inc_ref(ctx, value);
+
+		if (i > 0) fprintf(out, ", ");
+		fprintf(out, "%s = %s", vars[i]->id_name,
+			Z3_is_numeral_ast(ctx, value) ? Z3_get_numeral_string(ctx, value) : Z3_ast_to_string(ctx, value));
+
+		Z3_dec_ref(ctx, value);
+	}
+
+	fclose(out);
+	return text;
+}
+
+/* ------------------------------------------------------------------
+	Timeouts
+	Z3's own "timeout" parameter can hang a nonlinear check for good
+	(seen with Z3 4.8.12 on x*x*x + y*y*y + z*z*z == 33), while
+	Z3_interrupt from another thread reliably stops it. So a timeout
+	is a watchdog thread that interrupts the check when time runs out.
+   ------------------------------------------------------------------ */
+typedef struct {
+	Z3_context ctx;
+	unsigned ms;
+	int done;				// the check returned
+	int fired;				// the watchdog interrupted it
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+} Watchdog;
+
+static void* watchdog_main(void* arg) {
+	Watchdog* w = arg;
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += w->ms / 1000;
+	deadline.tv_nsec += (long)(w->ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&w->lock);
+	while (!w->done) {
+		if (pthread_cond_timedwait(&w->cond, &w->lock, &deadline) != 0) {
+			w->fired = 1;
+			Z3_interrupt(w->ctx);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+static void start_watchdog(Watchdog* w, Z3_context ctx, unsigned ms) {
+	w->ctx = ctx;
+	w->ms = ms;
+	w->done = 0;
+	w->fired = 0;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	if (pthread_create(&w->thread, NULL, watchdog_main, w) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+}
+
+// Returns 1 if the watchdog interrupted the check
+static int stop_watchdog(Watchdog* w) {
+	pthread_mutex_lock(&w->lock);
+	w->done = 1;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	return w->fired;
+}
+
+// Solver for a strategy, with the configured limits
+static Z3_solver make_solver(Z3_context ctx, const Strategy* strategy, const SolverConfig* config) {
+	Z3_solver solver;
+	if (strategy->tactic) {
+		Z3_tactic tactic = Z3_mk_tactic(ctx, strategy->tactic);
+		Z3_tactic_inc_ref(ctx, tactic);
+		solver = Z3_mk_solver_from_tactic(ctx, tactic);
+		Z3_tactic_dec_ref(ctx, tactic);
+	} else {
+		solver = Z3_mk_solver(ctx);
+	}
+	Z3_solver_inc_ref(ctx, solver);
+
+	Z3_params params = Z3_mk_params(ctx);
+	Z3_params_inc_ref(ctx, params);
+	if (config->rlimit) Z3_params_set_uint(ctx, params, Z3_mk_string_symbol(ctx, "rlimit"), config->rlimit);
+	if (strategy->seed) Z3_params_set_uint(ctx, params, Z3_mk_string_symbol(ctx, "random_seed"), strategy->seed);
+	Z3_solver_set_params(ctx, solver, params);
+	Z3_params_dec_ref(ctx, params);
+
+	return solver;
+}
+
+// Add what Z3 counted for this solver to the --stats totals
+static void add_solver_stats(Z3_context ctx, Z3_solver solver) {
+	if (!stats_enabled) return;
+	Z3_stats z3 = Z3_solver_get_statistics(ctx, solver);
+	Z3_stats_inc_ref(ctx, z3);
+	stats_add_z3(ctx, z3);
+	Z3_stats_dec_ref(ctx, z3);
+}
+
+static void free_result_strings(ObligationResult* res) {
+	free(res->model);
+	free(res->reason);
+	res->model = NULL;
+	res->reason = NULL;
+}
+
+// Check the assertions of `solver`, which negate obligation `ob`:
+// unsat => valid, a model is a counterexample. A set *cancel (portfolio)
+// skips the check: the obligation was decided while this one was set up.
+static ObligationResult run_check(Z3Env* env, Z3_solver solver, Obligation* ob, const Strategy* strategy,
+								const SolverConfig* config, const int* cancel) {
+	Z3_context ctx = env->ctx;
+	ObligationResult res = { .verdict = VERDICT_ERROR, .strategy = strategy->name };
+
+	if (cancel && __atomic_load_n(cancel, __ATOMIC_ACQUIRE)) {
+		res.verdict = VERDICT_UNKNOWN;
+		res.reason = strdup("canceled");
+		return res;
+	}
+
+	Watchdog watchdog;
+	if (config->timeout_ms) start_watchdog(&watchdog, ctx, config->timeout_ms);
+
+	PhaseTimer timer;
+	phase_begin(&timer);
+	Z3_lbool r = Z3_solver_check(ctx, solver);
+	phase_end(&timer, PHASE_CHECK);
+	Z3_error_code error = Z3_get_error_code(ctx);
+	int timed_out = config->timeout_ms && stop_watchdog(&watchdog);
+
+	if (timed_out && r != Z3_L_FALSE && r != Z3_L_TRUE) {
+		res.verdict = VERDICT_UNKNOWN;
+		res.reason = strdup("timeout");
+	} else if (error != Z3_OK) {
+		res.verdict = VERDICT_UNKNOWN;		// interrupted (portfolio)
+		res.reason = strdup(Z3_get_error_msg(ctx, error));
+	} else if (r == Z3_L_FALSE) {
+		res.verdict = VERDICT_VALID;		// UNSAT(¬F) ⇒ F is valid
+	} else if (r == Z3_L_TRUE) {
+		res.verdict = VERDICT_INVALID;		// SAT(¬F) ⇒ counterexample exists
+		Z3_model model = Z3_solver_get_model(ctx, solver);
+		Z3_model_inc_ref(ctx, model);
+		res.model = render_model(env, model, ob->vars, ob->nvars);
+		Z3_model_dec_ref(ctx, model);
+	} else {
+		res.verdict = VERDICT_UNKNOWN;		// timeout, resource limit, incompleteness
+		res.reason = strdup(Z3_solver_get_reason_unknown(ctx, solver));
+	}
+	return res;
+}
+
+// Check validity of one obligation: assert its negation, unsat => valid.
+// A satisfying assignment of the negation is a counterexample.
+static ObligationResult check_valid(Z3Env* env, Obligation* ob, const Strategy* strategy,
+									const SolverConfig* config, const int* cancel) {
+	Z3_context ctx = env->ctx;
+
+	PhaseTimer timer;
+	double t0 = now_ms();
+	phase_begin(&timer);
+	Z3_ast f = ast_to_z3(env, ob->formula);
+	phase_end(&timer, PHASE_TRANSLATE);
+	double translate_ms = now_ms() - t0;
+	if (!f) return (ObligationResult){ .verdict = VERDICT_ERROR, .strategy = strategy->name, .translate_ms = translate_ms };
+
+	Z3_solver solver = make_solver(ctx, strategy, config);
+
+	Z3_ast not_f = Z3_mk_not(ctx, f);
+	Z3_inc_ref(ctx, not_f);
+	Z3_solver_assert(ctx, solver, not_f);
+
+	ObligationResult res = run_check(env, solver, ob, strategy, config, cancel);
+	res.translate_ms = translate_ms;
+	add_solver_stats(ctx, solver);
+
+	Z3_dec_ref(ctx, not_f);
+	Z3_solver_dec_ref(ctx, solver);
+	return res;
+}
+
+/* ------------------------------------------------------------------
+	Incremental solving
+	Obligations from split_vc share hypotheses: every goal inside a
+	loop has the precondition and the loop's I ∧ B on its path, and
+	neighbouring obligations share the longest prefixes. In
+	incremental mode a worker keeps one solver whose assertion stack
+	mirrors the hypotheses of its previous obligation, one scope per
+	hypothesis. For the next obligation it pops down to the common
+	prefix (hypotheses are compared by node), pushes the new ones and
+	checks the negated goal in a scope of its own, so what Z3 learned
+	from the shared hypotheses is kept across checks.
+	After push the default solver no longer runs the nonlinear tactics,
+	so an incremental "unknown" is retried on a fresh solver, unless a
+	limit (--timeout, --rlimit) or a cancellation caused it: the fresh
+	solver would only hit it again.
+   ------------------------------------------------------------------ */
+typedef struct {
+	Z3_solver solver;		// NULL until first use
+	ASTNode** hyps;			// asserted hypotheses, one scope each
+	int depth;
+	int cap;
+} HypStack;
+
+static void free_HypStack(Z3Env* env, HypStack* st) {
+	if (st->solver) {
+		add_solver_stats(env->ctx, st->solver);	// cumulative over its checks
+		Z3_solver_dec_ref(env->ctx, st->solver);
+	}
+	free(st->hyps);
+	st->solver = NULL;
+	st->hyps = NULL;
+	st->depth = 0;
+	st->cap = 0;
+}
+
+// Z3 gave up because of a limit or an interrupt, not because of the
+// tactics the solver ran
+static int stopped_by_limit(const char* reason) {
+	return reason && (strcmp(reason, "timeout") == 0
+		|| strcmp(reason, "max. resource limit exceeded") == 0
+		|| strcmp(reason, "canceled") == 0);
+}
+
+static ObligationResult check_incremental(Z3Env* env, HypStack* st, Obligation* ob, const SolverConfig* config) {
+	Z3_context ctx = env->ctx;
+	const Strategy* strategy = &strategies[0];
+
+	// Translate everything first: a failure leaves the stack untouched
+	PhaseTimer timer;
+	double t0 = now_ms();
+	phase_begin(&timer);
+	Z3_ast goal = ast_to_z3(env, ob->goal);
+	int translated = goal != NULL;
+	for (int i = 0; translated && i < ob->nhyps; i++) {
+		translated = ast_to_z3(env, ob->hyps[i]) != NULL;
+	}
+	phase_end(&timer, PHASE_TRANSLATE);
+	double translate_ms = now_ms() - t0;
+	if (!translated) return (ObligationResult){ .verdict = VERDICT_ERROR, .strategy = strategy->name, .translate_ms = translate_ms };
+
+	if (!st->solver) st->solver = make_solver(ctx, strategy, config);
+	if (st->cap < ob->nhyps) {
+		st->cap = ob->nhyps;
+		st->hyps = realloc(st->hyps, st->cap * sizeof(ASTNode*));
+		if (!st->hyps) { perror("realloc"); exit(1); }
+	}
+
+	int keep = 0;
+	while (keep < st->depth && keep < ob->nhyps && st->hyps[keep] == ob->hyps[keep]) keep++;
+	if (st->depth > keep) Z3_solver_pop(ctx, st->solver, st->depth - keep);
+	for (st->depth = keep; st->depth < ob->nhyps; st->depth++) {
+		Z3_solver_push(ctx, st->solver);
+		Z3_solver_assert(ctx, st->solver, ast_to_z3(env, ob->hyps[st->depth]));
+		st->hyps[st->depth] = ob->hyps[st->depth];
+	}
+
+	Z3_ast not_goal = Z3_mk_not(ctx, goal);
+	Z3_inc_ref(ctx, not_goal);
+	Z3_solver_push(ctx, st->solver);
+	Z3_solver_assert(ctx, st->solver, not_goal);
+
+	ObligationResult res = run_check(env, st->solver, ob, strategy, config, NULL);
+	res.translate_ms = translate_ms;
+
+	Z3_solver_pop(ctx, st->solver, 1);
+	Z3_dec_ref(ctx, not_goal);
+
+	if (res.verdict == VERDICT_UNKNOWN && Z3_get_error_code(ctx) != Z3_OK) {
+		free_HypStack(env, st);		// interrupted: rebuilt for the next obligation
+	}
+	if (res.verdict == VERDICT_UNKNOWN && !stopped_by_limit(res.reason)) {
+		// e.g. "smt tactic failed to show goal to be sat/unsat" on
+		// nonlinear goals
+		free_result_strings(&res);
+		res = check_valid(env, ob, strategy, config, NULL);
+		res.translate_ms += translate_ms;
+	}
+	return res;
+}
+
+// One obligation raced by all strategies of a worker
+typedef struct {
+	Obligation* ob;
+	const SolverConfig* config;
+	Z3Env** envs;
+	ObligationResult results[PORTFOLIO_SIZE];
+	int finished[PORTFOLIO_SIZE];
+	int winner;				// -1 until a strategy answers definitively
+	int cancel;				// set with winner, read by run_check
+	pthread_mutex_t lock;
+	pthread_cond_t done;	// a racer finished
+} Race;
+
+typedef struct {
+	Race* race;
+	int k;
+} Racer;
+
+static void* racer_main(void* arg) {
+	Racer* r = arg;
+	Race* race = r->race;
+
+	pthread_mutex_lock(&race->lock);
+	int decided = race->winner >= 0;
+	pthread_mutex_unlock(&race->lock);
+
+	ObligationResult res = { .verdict = VERDICT_UNKNOWN, .strategy = strategies[r->k].name };
+	if (!decided) res = check_valid(race->envs[r->k], race->ob, &strategies[r->k], race->config, &race->cancel);
+
+	pthread_mutex_lock(&race->lock);
+	race->results[r->k] = res;
+	if (race->winner < 0 && (res.verdict == VERDICT_VALID || res.verdict == VERDICT_INVALID)) {
+		race->winner = r->k;
+		__atomic_store_n(&race->cancel, 1, __ATOMIC_RELEASE);
+		for (int j = 0; j < PORTFOLIO_SIZE; j++) {
+			if (!race->finished[j] && j != r->k) Z3_interrupt(race->envs[j]->ctx);
+		}
+	}
+	race->finished[r->k] = 1;
+	pthread_cond_signal(&race->done);
+	pthread_mutex_unlock(&race->lock);
+	return NULL;
+}
+
+// Race every strategy on one obligation; the first definitive answer wins,
+// otherwise the default strategy's answer is kept
+static ObligationResult check_portfolio(Z3Env** envs, Obligation* ob, const SolverConfig* config) {
+	Race race;
+	race.ob = ob;
+	race.config = config;
+	race.envs = envs;
+	race.winner = -1;
+	race.cancel = 0;
+	memset(race.finished, 0, sizeof(race.finished));
+	pthread_mutex_init(&race.lock, NULL);
+	pthread_cond_init(&race.done, NULL);
+
+	pthread_t threads[PORTFOLIO_SIZE];
+	Racer racers[PORTFOLIO_SIZE];
+	for (int k = 0; k < PORTFOLIO_SIZE; k++) {
+		racers[k].race = &race;
+		racers[k].k = k;
+		if (pthread_create(&threads[k], NULL, racer_main, &racers[k]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	// Z3_interrupt only stops a check already running: a racer past its
+	// cancel test but not yet in Z3_solver_check misses the winner's
+	// interrupt. Repeat it until every racer is back.
+	pthread_mutex_lock(&race.lock);
+	for (;;) {
+		int running = 0;
+		for (int k = 0; k < PORTFOLIO_SIZE; k++) running += !race.finished[k];
+		if (!running) break;
+
+		if (race.winner < 0) {
+			pthread_cond_wait(&race.done, &race.lock);
+			continue;
+		}
+		for (int k = 0; k < PORTFOLIO_SIZE; k++) {
+			if (!race.finished[k]) Z3_interrupt(envs[k]->ctx);
+		}
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_nsec += 1000000;	// 1 ms
+		if (until.tv_nsec >= 1000000000) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&race.done, &race.lock, &until);
+	}
+	pthread_mutex_unlock(&race.lock);
+
+	for (int k = 0; k < PORTFOLIO_SIZE; k++) {
+		pthread_join(threads[k], NULL);
+	}
+	pthread_cond_destroy(&race.done);
+	pthread_mutex_destroy(&race.lock);
+
+	int keep = race.winner >= 0 ? race.winner : 0;
+	for (int k = 0; k < PORTFOLIO_SIZE; k++) {
+		if (k != keep) free_result_strings(&race.results[k]);
+	}
+	return race.results[keep];
+}
+
+// Thread body: take obligations until none are left
+static void* worker_main(void* arg) {
+	Worker* w = arg;
+	SolveJob* job = w->job;
+	const SolverConfig* config = &w->pool->config;
+
+	HypStack stack = { NULL, NULL, 0, 0 };
+
+	for (;;) {
+		int first = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED);
+		if (first >= job->obligations->count) break;
+
+		int last = first + job->chunk;
+		if (last > job->obligations->count) last = job->obligations->count;
+
+		for (int i = first; i < last; i++) {
+			Obligation* ob = &job->obligations->items[i];
+			if (config->portfolio) {
+				job->results[i] = check_portfolio(w->envs, ob, config);
+			} else if (config->incremental) {
+				job->results[i] = check_incremental(w->envs[0], &stack, ob, config);
+			} else {
+				job->results[i] = check_valid(w->envs[0], ob, &strategies[0], config, NULL);
+			}
+		}
+	}
+
+	free_HypStack(w->envs[0], &stack);
+	return NULL;
+}
+
+// Check every obligation; results[i] receives the result of obligation i.
+// Formulas must already be built (the AST arena is not thread-safe).
+void solve_obligations(SolverPool* pool, ObligationList* obligations, ObligationResult* results) {
+	SolveJob job = { obligations, results, 0, 1 };
+
+	if (obligations->count == 0) return;
+
+	int nthreads = pool->nworkers;
+	if (nthreads > obligations->count) nthreads = obligations->count;
+
+	// Incremental workers take consecutive obligations, which share the
+	// most hypotheses (one contiguous slice per thread)
+	if (pool->config.incremental && !pool->config.portfolio) {
+		job.chunk = (obligations->count + nthreads - 1) / nthreads;
+	}
+
+	if (nthreads <= 1) {
+		Worker w = { &job, pool, worker_envs(pool, 0) };
+		worker_main(&w);
+		return;
+	}
+
+	pthread_t* threads = malloc(nthreads * sizeof(pthread_t));
+	Worker* workers = malloc(nthreads * sizeof(Worker));
+	if (!threads || !workers) { perror("malloc"); exit(1); }
+
+	for (int i = 0; i < nthreads; i++) {
+		workers[i].job = &job;
+		workers[i].pool = pool;
+		workers[i].envs = worker_envs(pool, i);
+		if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+	free(workers);
+}
+
+// Free the result strings (the array itself belongs to the caller)
+void free_ObligationResults(ObligationResult* results, int count) {
+	for (int i = 0; i < count; i++) {
+		free_result_strings(&results[i]);
+	}
+}
+
+// Drop cached translations; call before the AST arena is reset
+void solver_pool_reset(SolverPool* pool) {
+	for (int i = 0; i < pool->nworkers * pool->width; i++) {
+		if (pool->envs[i]) z3env_clear_terms(pool->envs[i]);
+	}
+}
+
+void free_SolverPool(SolverPool* pool) {
+	if (!pool) return;
+
+	for (int i = 0; i < pool->nworkers * pool->width; i++) {
+		if (pool->envs[i]) free_Z3Env(pool->envs[i]);
+	}
+	free(pool->envs);
+	free(pool);
+}
+
+const char* verdict_to_string(Verdict v) {
+	switch (v) {
+		case VERDICT_VALID:		return "valid";
+		case VERDICT_INVALID:	return "NOT valid";
+		case VERDICT_UNKNOWN:	return "unknown";
+		case VERDICT_ERROR:		return "error";
+	}
+	return "?";
+}
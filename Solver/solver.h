@@ -0,0 +1,48 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "vc.h"
+#include "z3_helpers.h"
+
+typedef enum { VERDICT_VALID, VERDICT_INVALID, VERDICT_UNKNOWN, VERDICT_ERROR } Verdict;
+
+// Outcome of one obligation. For VERDICT_INVALID, model holds a
+// counterexample over the obligation's variables ("n = 0, s = 5"),
+// malloc'd; release with free_ObligationResults.
+typedef struct ObligationResult_ {
+	Verdict verdict;
+	char* model;
+	char* reason;			// why Z3 gave up (VERDICT_UNKNOWN), malloc'd
+	const char* strategy;	// portfolio strategy that answered (static)
+	double translate_ms;	// time spent in ast_to_z3 (0 if not sent to Z3)
+} ObligationResult;
+
+// Limits applied to every check (0 = none) and strategy selection
+typedef struct SolverConfig_ {
+	unsigned timeout_ms;	// per obligation, wall clock
+	unsigned rlimit;		// per obligation, Z3 resource units (deterministic)
+	int portfolio;			// race several strategies per obligation
+	int incremental;		// share asserted hypotheses between checks (push/pop)
+} SolverConfig;
+
+// A fixed set of workers, each owning its own Z3 context (contexts are not
+// thread-safe, so a context is never touched by two threads at once).
+// In portfolio mode a worker owns one context per strategy.
+// Contexts are created on first use and kept for later calls.
+typedef struct SolverPool_ {
+	int nworkers;
+	int width;				// contexts per worker
+	SolverConfig config;
+	Z3Env** envs;			// nworkers * width
+} SolverPool;
+
+
+SolverPool* create_SolverPool(int nworkers, SolverConfig config);
+void solve_obligations(SolverPool* pool, ObligationList* obligations, ObligationResult* results);
+void free_ObligationResults(ObligationResult* results, int count);
+void solver_pool_reset(SolverPool* pool);
+void free_SolverPool(SolverPool* pool);
+
+const char* verdict_to_string(Verdict v);
+
+#endif
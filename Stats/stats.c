@@ -0,0 +1,156 @@
+#include "stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------
+	Instrumentation (--stats)
+	Process-wide totals, updated by every thread: time and calls per
+	phase, a few event counters, the largest VC built and the sum of
+	Z3's own statistics over all solvers. Disabled, each hook costs one
+	test of stats_enabled; phase timers also read the thread's CPU
+	clock, so CPU times of the solver threads add up.
+   ------------------------------------------------------------------ */
+
+int stats_enabled = 0;
+unsigned long stats_counters[COUNTER_COUNT];
+
+typedef struct {
+	unsigned long calls;
+	double wall_ms;
+	double cpu_ms;
+} PhaseTotal;
+
+// One Z3 statistic, summed over all solvers (process-wide ones: maximum)
+typedef struct {
+	char* key;
+	int is_double;
+	int is_max;
+	unsigned long long uint_value;
+	double double_value;
+} Z3Stat;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static PhaseTotal phases[PHASE_COUNT];
+static unsigned long long peak_vc_nodes = 0;
+static unsigned long peak_vc_depth = 0;
+static Z3Stat* z3_stats = NULL;
+static int z3_count = 0;
+static int z3_capacity = 0;
+
+static const char* phase_names[PHASE_COUNT] = {
+	"parse", "vcgen", "simplify", "split", "translate", "check"
+};
+
+static const char* counter_names[COUNTER_COUNT] = {
+	"nodes_allocated", "nodes_freed", "clone_node", "substitute"
+};
+
+
+void stats_enable(void) {
+	stats_enabled = 1;
+}
+
+static double clock_ms(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void phase_begin(PhaseTimer* t) {
+	if (!stats_enabled) return;
+	t->wall = clock_ms(CLOCK_MONOTONIC);
+	t->cpu = clock_ms(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void phase_end(PhaseTimer* t, Phase phase) {
+	if (!stats_enabled) return;
+	double wall = clock_ms(CLOCK_MONOTONIC) - t->wall;
+	double cpu = clock_ms(CLOCK_THREAD_CPUTIME_ID) - t->cpu;
+
+	pthread_mutex_lock(&stats_lock);
+	phases[phase].calls++;
+	phases[phase].wall_ms += wall;
+	phases[phase].cpu_ms += cpu;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+// Record the size and depth of a VC (the largest one is reported)
+void stats_vc(unsigned long long nodes, unsigned long depth) {
+	if (!stats_enabled) return;
+	pthread_mutex_lock(&stats_lock);
+	if (nodes > peak_vc_nodes) peak_vc_nodes = nodes;
+	if (depth > peak_vc_depth) peak_vc_depth = depth;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static Z3Stat* z3_stat(const char* key) {
+	for (int i = 0; i < z3_count; i++) {
+		if (strcmp(z3_stats[i].key, key) == 0) return &z3_stats[i];
+	}
+	if (z3_count == z3_capacity) {
+		z3_capacity = z3_capacity ? 2 * z3_capacity : 64;
+		z3_stats = realloc(z3_stats, z3_capacity * sizeof(Z3Stat));
+		if (!z3_stats) { perror("realloc"); exit(1); }
+	}
+	Z3Stat* s = &z3_stats[z3_count++];
+	memset(s, 0, sizeof(Z3Stat));
+	s->key = strdup(key);
+	// process-wide figures, not per solver
+	s->is_max = strcmp(key, "memory") == 0 || strcmp(key, "num allocs") == 0 || strncmp(key, "max ", 4) == 0;
+	return s;
+}
+
+// Add the statistics of one solver (Z3_solver_get_statistics) to the totals
+void stats_add_z3(Z3_context ctx, Z3_stats z3) {
+	if (!stats_enabled) return;
+	pthread_mutex_lock(&stats_lock);
+	unsigned n = Z3_stats_size(ctx, z3);
+	for (unsigned i = 0; i < n; i++) {
+		Z3Stat* s = z3_stat(Z3_stats_get_key(ctx, z3, i));
+		if (Z3_stats_is_double(ctx, z3, i)) {
+			double v = Z3_stats_get_double_value(ctx, z3, i);
+			s->is_double = 1;
+			s->double_value = s->is_max ? (v > s->double_value ? v : s->double_value) : s->double_value + v;
+		} else {
+			unsigned long long v = Z3_stats_get_uint_value(ctx, z3, i);
+			s->uint_value = s->is_max ? (v > s->uint_value ? v : s->uint_value) : s->uint_value + v;
+		}
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void fprint_json_key(FILE* out, const char* key) {
+	fputc('"', out);
+	for (; *key; key++) fputc(*key == '"' || *key == '\\' ? '_' : *key, out);
+	fputs("\": ", out);
+}
+
+// One line: {"stats": {"phases": {...}, counters, "peak_vc_nodes": ..., "peak_vc_depth": ..., "z3": {...}}}
+void fprint_stats_json(FILE* out) {
+	pthread_mutex_lock(&stats_lock);
+
+	fprintf(out, "{\"stats\": {\"phases\": {");
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		fprintf(out, "%s\"%s\": {\"calls\": %lu, \"wall_ms\": %.3f, \"cpu_ms\": %.3f}", p ? ", " : "",
+			phase_names[p], phases[p].calls, phases[p].wall_ms, phases[p].cpu_ms);
+	}
+	fprintf(out, "}");
+
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		fprintf(out, ", \"%s\": %lu", counter_names[c], __atomic_load_n(&stats_counters[c], __ATOMIC_RELAXED));
+	}
+	fprintf(out, ", \"peak_vc_nodes\": %llu, \"peak_vc_depth\": %lu", peak_vc_nodes, peak_vc_depth);
+
+	fprintf(out, ", \"z3\": {");
+	for (int i = 0; i < z3_count; i++) {
+		if (i) fprintf(out, ", ");
+		fprint_json_key(out, z3_stats[i].key);
+		if (z3_stats[i].is_double) fprintf(out, "%.3f", z3_stats[i].double_value);
+		else fprintf(out, "%llu", z3_stats[i].uint_value);
+	}
+	fprintf(out, "}}}\n");
+
+	pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,40 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <z3.h>
+
+// Phases timed by --stats (wall and CPU time, number of calls)
+typedef enum { PHASE_PARSE, PHASE_VCGEN, PHASE_SIMPLIFY, PHASE_SPLIT,
+					PHASE_TRANSLATE, PHASE_CHECK, PHASE_COUNT } Phase;
+
+// Event counters
+typedef enum { COUNTER_NODES_ALLOCATED, COUNTER_NODES_FREED, COUNTER_CLONE,
+					COUNTER_SUBSTITUTE, COUNTER_COUNT } Counter;
+
+// Start of one timed call (only filled in when stats are enabled)
+typedef struct {
+	double wall;
+	double cpu;
+} PhaseTimer;
+
+// Set once by main before any work starts; everything below is a no-op without it
+extern int stats_enabled;
+extern unsigned long stats_counters[COUNTER_COUNT];
+
+void stats_enable(void);
+
+void phase_begin(PhaseTimer* t);
+void phase_end(PhaseTimer* t, Phase phase);
+
+// Safe to call from any thread
+static inline void stats_count(Counter c, unsigned long n) {
+	if (stats_enabled) __atomic_fetch_add(&stats_counters[c], n, __ATOMIC_RELAXED);
+}
+
+void stats_vc(unsigned long long nodes, unsigned long depth);
+void stats_add_z3(Z3_context ctx, Z3_stats z3);
+
+void fprint_stats_json(FILE* out);
+
+#endif
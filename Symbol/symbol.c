@@ -0,0 +1,105 @@
+#include "symbol.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------
+	Symbol table
+	The lexer interns every identifier it reads, so the AST refers to
+	variables by number: substitution and the Z3 variable cache compare
+	and index integers instead of strings.
+	Names live in fixed-size pages that never move, so symbol_name()
+	reads them without taking the lock: a symbol only reaches another
+	thread after intern_symbol() has filled its slot. The name -> symbol
+	index is open addressing with stored hashes, under the lock.
+   ------------------------------------------------------------------ */
+
+#define PAGE_BITS	10
+#define PAGE_SIZE	(1 << PAGE_BITS)
+#define MAX_PAGES	16384			// 16M symbols
+
+typedef struct {
+	unsigned long hash;
+	int sym;						// 0: empty slot
+} SymbolSlot;
+
+static pthread_mutex_t symbol_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char** pages[MAX_PAGES];
+static int count = 0;				// symbols 1..count are in use
+
+static SymbolSlot* slots = NULL;
+static int capacity = 0;			// power of two
+
+
+static unsigned long name_hash(const char* name) {
+	unsigned long h = 5381;
+	while (*name) h = h * 33 + (unsigned char)*name++;
+	return h;
+}
+
+const char* symbol_name(int sym) {
+	return pages[sym >> PAGE_BITS][sym & (PAGE_SIZE - 1)];
+}
+
+int symbol_count(void) {
+	return __atomic_load_n(&count, __ATOMIC_ACQUIRE);
+}
+
+// Double the index (stored hashes: no name is rehashed)
+static void grow_index(void) {
+	SymbolSlot* old = slots;
+	int old_capacity = capacity;
+
+	capacity = capacity ? 2 * capacity : 1024;
+	slots = calloc(capacity, sizeof(SymbolSlot));
+	if (!slots) { perror("calloc"); exit(1); }
+
+	int mask = capacity - 1;
+	for (int i = 0; i < old_capacity; i++) {
+		if (!old[i].sym) continue;
+		int j = (int)(old[i].hash & (unsigned long)mask);
+		while (slots[j].sym) j = (j + 1) & mask;
+		slots[j] = old[i];
+	}
+	free(old);
+}
+
+// Symbol of name, allocated on first use
+int intern_symbol(const char* name) {
+	unsigned long hash = name_hash(name);
+
+	pthread_mutex_lock(&symbol_lock);
+	if ((count + 1) * 4 > capacity * 3) grow_index();
+
+	int mask = capacity - 1;
+	int i = (int)(hash & (unsigned long)mask);
+	while (slots[i].sym) {
+		if (slots[i].hash == hash && strcmp(symbol_name(slots[i].sym), name) == 0) {
+			int sym = slots[i].sym;
+			pthread_mutex_unlock(&symbol_lock);
+			return sym;
+		}
+		i = (i + 1) & mask;
+	}
+
+	int sym = count + 1;
+	if ((sym >> PAGE_BITS) >= MAX_PAGES) {
+		fprintf(stderr, "intern_symbol: too many identifiers\n");
+		exit(1);
+	}
+	if (!pages[sym >> PAGE_BITS]) {
+		pages[sym >> PAGE_BITS] = calloc(PAGE_SIZE, sizeof(char*));
+		if (!pages[sym >> PAGE_BITS]) { perror("calloc"); exit(1); }
+	}
+	char* copy = strdup(name);
+	if (!copy) { perror("strdup"); exit(1); }
+	pages[sym >> PAGE_BITS][sym & (PAGE_SIZE - 1)] = copy;
+
+	slots[i].hash = hash;
+	slots[i].sym = sym;
+	__atomic_store_n(&count, sym, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&symbol_lock);
+	return sym;
+}
@@ -0,0 +1,11 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+// Interned identifiers: each distinct name is stored once, for the life of
+// the process, and numbered 1, 2, ... (0 is never a symbol). Two names are
+// equal iff their symbols are. Safe to use from several threads.
+int intern_symbol(const char* name);
+const char* symbol_name(int sym);
+int symbol_count(void);
+
+#endif
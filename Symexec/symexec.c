@@ -0,0 +1,132 @@
+#include "symexec.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ------------------------------------------------------------------
+	Symbolic execution of a block
+	The block is run forwards once, keeping for every variable its
+	value as a term over the entry state (x, y, ... stand for the
+	values on entry):
+		- x := E binds x to E[env];
+		- after if (B) S else T, a variable whose value differs
+		  between the branches is bound to ite(B[env], v_S, v_T);
+		- an inner loop runs any number of times: every variable it
+		  assigns gets a fresh name x'k (an unknown value), and
+		  I ∧ ¬B in that state (under the conditions of the
+		  enclosing branches) is recorded as an assumption. Without
+		  the fresh names the exit condition would be read in the
+		  state before the loop, where it usually contradicts the
+		  outer I ∧ B and makes the variant check vacuous.
+	Then for any formula Q over the variables, Q[env] is its value
+	after the block, in one traversal of Q. hoare_WhileRule uses it
+	for the invariant after an iteration and for the variant.
+   ------------------------------------------------------------------ */
+
+static void exec_block(DLL* code, SubstEnv* env, ASTNode** assumption, int* fresh);
+
+
+static ASTNode* conjoin(ASTNode* a, ASTNode* b) {
+	if (!a) return b;
+	if (!b) return a;
+	return create_node_binary(OP_AND, a, b);
+}
+
+// Value of x in env (x itself if it was never assigned)
+static ASTNode* value_of(const SubstEnv* env, int x) {
+	ASTNode* term = subst_env_lookup(env, x);
+	return term ? term : create_node_symbol(x);
+}
+
+// Bind in env every variable of branch whose value differs from the other branch
+static void merge_branch(SubstEnv* env, ASTNode* condition, const SubstEnv* branch,
+						const SubstEnv* env_then, const SubstEnv* env_else) {
+	for (int i = 0; i < branch->capacity; i++) {
+		int x = branch->syms[i];
+		if (!x) continue;
+
+		ASTNode* v_then = value_of(env_then, x);
+		ASTNode* v_else = value_of(env_else, x);
+		subst_env_bind(env, x, v_then == v_else ? v_then : create_node_ite(condition, v_then, v_else));
+	}
+}
+
+// Fresh variable x'k (distinct from the x#k names of passive.c, which
+// may share a VC with it)
+static ASTNode* fresh_id(int x, int* fresh) {
+	return create_node_fresh(x, '\'', ++*fresh);
+}
+
+static void exec_if(ASTNode* node, SubstEnv* env, ASTNode** assumption, int* fresh) {
+	ASTNode* condition = substitute_env(node->If.condition, env);
+
+	SubstEnv* env_then = copy_SubstEnv(env);
+	SubstEnv* env_else = copy_SubstEnv(env);
+	ASTNode* then_facts = NULL;
+	ASTNode* else_facts = NULL;
+	exec_block(node->If.block_if, env_then, &then_facts, fresh);
+	exec_block(node->If.block_else, env_else, &else_facts, fresh);
+
+	// Variables bound in both envs are visited twice; the result is the same
+	merge_branch(env, condition, env_then, env_then, env_else);
+	merge_branch(env, condition, env_else, env_then, env_else);
+
+	if (then_facts || else_facts) {
+		*assumption = conjoin(*assumption, create_node_binary(OP_AND,
+			create_node_binary(OP_IMPLY, condition, then_facts ? then_facts : create_node_bool(1)),
+			create_node_binary(OP_IMPLY, create_node_unary(OP_NOT, condition),
+				else_facts ? else_facts : create_node_bool(1))));
+	}
+
+	free_SubstEnv(env_then);
+	free_SubstEnv(env_else);
+}
+
+static void exec_while(ASTNode* node, SubstEnv* env, ASTNode** assumption, int* fresh) {
+	int* assigned;
+	int count = block_assigned(node->While.block_main, &assigned);
+	for (int i = 0; i < count; i++) subst_env_bind(env, assigned[i], fresh_id(assigned[i], fresh));
+	free(assigned);
+
+	ASTNode* after = create_node_binary(OP_AND,
+		node->While.invariant,
+		create_node_unary(OP_NOT, node->While.condition));
+
+	*assumption = conjoin(*assumption, substitute_env(after, env));
+}
+
+static void exec_block(DLL* code, SubstEnv* env, ASTNode** assumption, int* fresh) {
+	if (!code) return;
+
+	for (int i = 0; i < code->count; i++) {
+		ASTNode* node = code->stmts[i];
+		switch (node->type) {
+			case NODE_ASSIGN:
+				subst_env_bind(env, node->Assign.sym, substitute_env(node->Assign.expr, env));
+				break;
+			case NODE_IF_ELSE:
+				exec_if(node, env, assumption, fresh);
+				break;
+			case NODE_WHILE:
+				exec_while(node, env, assumption, fresh);
+				break;
+			default:
+				fprintf(stderr, "symexec_block: unsupported node type %d\n", node->type);
+				break;
+		}
+	}
+}
+
+// Post-state of code (see above). Terms are allocated from the AST
+// arena; the env must be released with free_SymState. Fresh names are
+// numbered per call: they only occur in the obligations of one loop.
+SymState symexec_block(DLL* code) {
+	SymState state = { create_SubstEnv(), NULL };
+	int fresh = 0;
+	exec_block(code, state.env, &state.assumption, &fresh);
+	return state;
+}
+
+void free_SymState(SymState* state) {
+	free_SubstEnv(state->env);
+	state->env = NULL;
+}
@@ -0,0 +1,15 @@
+#ifndef SYMEXEC_H
+#define SYMEXEC_H
+
+#include "ast.h"
+
+// Effect of one run of a block, over the values its variables had on entry
+typedef struct {
+	SubstEnv* env;			// x -> value of x after the block (unbound: unchanged)
+	ASTNode* assumption;	// what inner loops guarantee on exit (NULL: nothing)
+} SymState;
+
+SymState symexec_block(DLL* code);
+void free_SymState(SymState* state);
+
+#endif
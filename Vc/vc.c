@@ -0,0 +1,168 @@
+#include "vc.h"
+#include "hoare.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------
+	VC splitting
+	The VC built by the Hoare rules is a tree of conjunctions under
+	implications:  pre -> ((I ∧ B -> wp) ∧ (I ∧ ¬B -> post) ∧ ...),
+	flattened (flatten_formula) so that a chain of conjunctions is
+	mostly one node; an operand that is itself a conjunction (a shared
+	link of the chain) is split the same way when it is reached.
+	Its validity is the validity of every leaf goal under the hypotheses
+	on its path:
+		split(A ∧ B, H)  = split(A, H) ∪ split(B, H)
+		split(P -> G, H) = split(G, H ∪ {P})
+		split(true, H)   = {}
+		split(G, H)      = { H -> G }
+	The resulting obligations are independent and can be checked in any
+	order, on any number of solvers. All memory comes from the AST arena.
+	Labels met on the way down (see hoare.c) are collected into a path,
+	"while (i < n): exit / if (x > 0): then-branch", naming the obligation.
+   ------------------------------------------------------------------ */
+
+// Traversal state of split_vc: hypothesis and label stacks
+typedef struct {
+	ObligationList* list;
+	ASTNode** hyps;
+	int hyps_cap;
+	const char** labels;
+	int labels_cap;
+} SplitState;
+
+// Grow a stack of pointers (malloc'd) so that it holds at least n + 1 entries
+static void* grow_stack(void* stack, int* cap, int n, size_t elem) {
+	if (n < *cap) return stack;
+	*cap *= 2;
+	stack = realloc(stack, *cap * elem);
+	if (!stack) { perror("realloc"); exit(1); }
+	return stack;
+}
+
+// Join a label path with " / " into an arena string
+static const char* join_labels(const char** labels, int n) {
+	if (n == 0) return "postcondition";
+
+	size_t len = 1;
+	for (int i = 0; i < n; i++) len += strlen(labels[i]) + 3;
+
+	char* text = ast_alloc(len);
+	text[0] = '\0';
+	for (int i = 0; i < n; i++) {
+		if (i > 0) strcat(text, " / ");
+		strcat(text, labels[i]);
+	}
+	return text;
+}
+
+static ObligationList* create_ObligationList(void) {
+	ObligationList* list = ast_alloc(sizeof(ObligationList));
+	list->count = 0;
+	list->capacity = 8;
+	list->items = ast_alloc(list->capacity * sizeof(Obligation));
+	return list;
+}
+
+// Append hyps -> goal (hypotheses copied out of the traversal stack)
+static void add_obligation(ObligationList* list, ASTNode** hyps, int nhyps, ASTNode* goal, const char* label) {
+	if (list->count == list->capacity) {
+		Obligation* bigger = ast_alloc(2 * list->capacity * sizeof(Obligation));
+		memcpy(bigger, list->items, list->count * sizeof(Obligation));
+		list->items = bigger;
+		list->capacity *= 2;
+	}
+
+	Obligation* ob = &list->items[list->count++];
+	ob->nhyps = nhyps;
+	ob->hyps = ast_alloc((nhyps ? nhyps : 1) * sizeof(ASTNode*));
+	if (nhyps) memcpy(ob->hyps, hyps, nhyps * sizeof(ASTNode*));
+	ob->goal = goal;
+	ob->formula = obligation_formula(ob);
+	ob->label = label;
+	ob->nvars = ast_collect_ids(ob->formula, &ob->vars);
+}
+
+// One pending subformula: the goal and the depth of the hypothesis and
+// label stacks on its path. Conjuncts are pushed right to left so that
+// obligations come out in source order; an entry below a given depth is
+// only rewritten once everything pushed above it has been split.
+typedef struct {
+	ASTNode* node;
+	int nhyps;
+	int nlabels;
+} SplitFrame;
+
+static void split_walk(SplitState* st, ASTNode* vc) {
+	WorkStack stack;
+	work_init(&stack, sizeof(SplitFrame));
+	*(SplitFrame*)work_push(&stack) = (SplitFrame){ vc, 0, 0 };
+
+	SplitFrame* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		SplitFrame frame = *top;
+		ASTNode* node = frame.node;
+
+		if (node->type == NODE_BIN_OP && node->binary_op.op == OP_AND) {
+			*(SplitFrame*)work_push(&stack) = (SplitFrame){ node->binary_op.right, frame.nhyps, frame.nlabels };
+			*(SplitFrame*)work_push(&stack) = (SplitFrame){ node->binary_op.left, frame.nhyps, frame.nlabels };
+			continue;
+		}
+
+		if (node->type == NODE_NARY && node->nary.op == OP_AND) {
+			for (int i = node->nary.count - 1; i >= 0; i--) {
+				*(SplitFrame*)work_push(&stack) = (SplitFrame){ node->nary.args[i], frame.nhyps, frame.nlabels };
+			}
+			continue;
+		}
+
+		if (node->type == NODE_BIN_OP && node->binary_op.op == OP_IMPLY) {
+			st->hyps = grow_stack(st->hyps, &st->hyps_cap, frame.nhyps, sizeof(ASTNode*));
+			st->hyps[frame.nhyps] = node->binary_op.left;
+			*(SplitFrame*)work_push(&stack) = (SplitFrame){ node->binary_op.right, frame.nhyps + 1, frame.nlabels };
+			continue;
+		}
+
+		if (node->type == NODE_LABEL) {
+			st->labels = grow_stack(st->labels, &st->labels_cap, frame.nlabels, sizeof(char*));
+			st->labels[frame.nlabels] = node->label.text;
+			*(SplitFrame*)work_push(&stack) = (SplitFrame){ node->label.child, frame.nhyps, frame.nlabels + 1 };
+			continue;
+		}
+
+		if (is_node_true(node)) continue; // nothing to prove
+
+		add_obligation(st->list, st->hyps, frame.nhyps, node, join_labels(st->labels, frame.nlabels));
+	}
+
+	work_free(&stack);
+}
+
+// Break a VC into independent obligations (see above)
+ObligationList* split_vc(ASTNode* vc) {
+	SplitState st = { create_ObligationList(), NULL, 16, NULL, 16 };
+	st.hyps = malloc(st.hyps_cap * sizeof(ASTNode*));
+	st.labels = malloc(st.labels_cap * sizeof(char*));
+	if (!st.hyps || !st.labels) { perror("malloc"); exit(1); }
+
+	split_walk(&st, vc);
+
+	free(st.hyps);
+	free(st.labels);
+	return st.list;
+}
+
+// Wrap a VC unchanged as the only obligation (monolithic check)
+ObligationList* single_obligation(ASTNode* vc) {
+	ObligationList* list = create_ObligationList();
+	add_obligation(list, NULL, 0, vc, "whole VC");
+	return list;
+}
+
+// Rebuild the implication hyps -> goal as one formula (the hypotheses
+// joined by a single n-ary conjunction)
+ASTNode* obligation_formula(const Obligation* ob) {
+	if (ob->nhyps == 0) return ob->goal;
+	return create_node_binary(OP_IMPLY, create_node_nary(OP_AND, ob->hyps, ob->nhyps), ob->goal);
+}
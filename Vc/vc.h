@@ -0,0 +1,28 @@
+#ifndef VC_H
+#define VC_H
+
+#include "ast.h"
+
+// One independent proof goal: (hyps[0] and ... and hyps[nhyps-1]) -> goal
+typedef struct Obligation_ {
+	ASTNode** hyps;		// hypotheses, outermost first
+	int nhyps;
+	ASTNode* goal;
+	ASTNode* formula;	// the whole implication, built by split_vc
+	const char* label;	// where it comes from, e.g. "while (i < n): exit"
+	ASTNode** vars;		// its variables, for rendering counterexamples
+	int nvars;
+} Obligation;
+
+typedef struct ObligationList_ {
+	Obligation* items;
+	int count;
+	int capacity;
+} ObligationList;
+
+
+ObligationList* split_vc(ASTNode* vc);
+ObligationList* single_obligation(ASTNode* vc);
+ASTNode* obligation_formula(const Obligation* ob);
+
+#endif
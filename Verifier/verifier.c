@@ -0,0 +1,455 @@
+#include "verifier.h"
+#include "hoare.h"
+#include "passive.h"
+#include "simplify.h"
+#include "stats.h"
+#include "parser.tab.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------
+	Verification pipeline shared by all front ends:
+		parse -> hoare_prover (or passive_wp) -> simplify_formula -> flatten_formula
+			-> split_vc -> solve_obligations
+	A Verifier is created once and reused for any number of programs.
+	Between programs only the AST arena is reset and the per-context
+	term caches are cleared; the Z3 contexts themselves (with their
+	`fact` declaration and variable constants) are kept warm.
+   ------------------------------------------------------------------ */
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+Verifier* create_Verifier(VerifierOptions opts) {
+	Verifier* v = malloc(sizeof(Verifier));
+	if (!v) { perror("malloc"); exit(1); }
+
+	if (opts.jobs < 1) opts.jobs = 1;
+	v->opts = opts;
+	v->arena = create_Arena(0);
+	v->nodes_mark = ast_nodes_allocated();
+	v->pool = create_SolverPool(opts.jobs, opts.solver);
+	return v;
+}
+
+// Overall status from the obligation verdicts
+static ProgramStatus summarize(const ObligationResult* results, int count) {
+	int undecided = 0;
+	for (int i = 0; i < count; i++) {
+		if (results[i].verdict == VERDICT_INVALID) return PROGRAM_INCORRECT;
+		if (results[i].verdict != VERDICT_VALID) undecided++;
+	}
+	return undecided ? PROGRAM_UNKNOWN : PROGRAM_CORRECT;
+}
+
+// Parse and verify one program read from `in`
+void verify_file(Verifier* v, FILE* in, VerifyResult* res) {
+	verify_prepare(v, in, res);
+	if (res->obligations) verify_solve(v, res, NULL);
+}
+
+// Parse a program and split its VC into obligations (res->obligations).
+// On a parse error, an unsupported program or one that fails a concrete
+// run (opts.prescreen), res->obligations stays NULL.
+void verify_prepare(Verifier* v, FILE* in, VerifyResult* res) {
+	memset(res, 0, sizeof(VerifyResult));
+	ast_set_arena(v->arena);
+	unsigned long allocated_before = ast_nodes_allocated();
+
+	// ----------------------------
+	// Parse
+	// ----------------------------
+	PhaseTimer timer;
+	double t0 = now_ms();
+	phase_begin(&timer);
+	res->program = parse_program(in);
+	phase_end(&timer, PHASE_PARSE);
+	double t1 = now_ms();
+	res->parse_ms = t1 - t0;
+
+	if (!res->program) {
+		res->status = PROGRAM_PARSE_ERROR;
+		return;
+	}
+
+	// "PRECONDITION: true" is not supported
+	if (is_node_true(res->program->pre)) {
+		res->status = PROGRAM_UNSUPPORTED;
+		return;
+	}
+
+	// ----------------------------
+	// Concrete runs: a failed check is a counterexample, no VC needed
+	// ----------------------------
+	if (v->opts.prescreen > 0) {
+		int failed = prescreen_program(res->program, v->opts.prescreen, &res->prescreen);
+		double tp = now_ms();
+		res->prescreen_ms = tp - t1;
+		t1 = tp;
+		if (failed) {
+			res->status = PROGRAM_INCORRECT;
+			return;
+		}
+	}
+
+	// ----------------------------
+	// VC generation and splitting
+	// ----------------------------
+	phase_begin(&timer);
+	ASTNode* wp = v->opts.passive
+		? passive_wp(res->program, res->program->post)
+		: hoare_prover(res->program, res->program->post);
+	res->vc = create_node_binary(OP_IMPLY, res->program->pre, wp);
+	phase_end(&timer, PHASE_VCGEN);
+	res->vc_raw_nodes = ast_count_nodes(res->vc);
+	if (stats_enabled) stats_vc(res->vc_raw_nodes, ast_depth(res->vc));
+
+	if (v->opts.simplify) {
+		phase_begin(&timer);
+		res->vc = simplify_formula(res->vc);
+		phase_end(&timer, PHASE_SIMPLIFY);
+	}
+	phase_begin(&timer);
+	res->vc = flatten_formula(res->vc);
+	res->obligations = v->opts.split ? split_vc(res->vc) : single_obligation(res->vc);
+	phase_end(&timer, PHASE_SPLIT);
+	double t2 = now_ms();
+	res->vcgen_ms = t2 - t1;
+
+	res->vc_tree_nodes = ast_count_nodes(res->vc);
+	res->vc_distinct_nodes = ast_count_distinct(res->vc);
+	res->nodes_allocated = ast_nodes_allocated() - allocated_before;
+
+	int count = res->obligations->count;
+	res->results = calloc(count ? count : 1, sizeof(ObligationResult));
+	if (!res->results) { perror("malloc"); exit(1); }
+}
+
+// Discharge the obligations of a prepared program. If `known` is given,
+// results[i] with known[i] != 0 were filled in by the caller (e.g. from a
+// previous run). Of the others, those found in the proof cache are not
+// sent to the solvers either; new definitive verdicts are added to it.
+void verify_solve(Verifier* v, VerifyResult* res, const char* known) {
+	ObligationList* obligations = res->obligations;
+	ProofCache* cache = v->opts.cache;
+	int count = obligations->count;
+	size_t slots = count > 0 ? (size_t)count : 1;
+	double t0 = now_ms();
+
+	char* done = calloc(slots, 1);
+	if (!done) { perror("malloc"); exit(1); }
+	if (known) memcpy(done, known, count);
+
+	// Answer what earlier runs already proved (or refuted)
+	CacheKey* keys = NULL;
+	if (cache) {
+		keys = ast_alloc(slots * sizeof(CacheKey));
+		for (int i = 0; i < count; i++) {
+			if (done[i]) continue;
+			keys[i] = proof_cache_key(obligations->items[i].formula);
+			if (proof_cache_lookup(cache, &keys[i], &res->results[i])) {
+				done[i] = 1;
+				res->cache_hits++;
+			} else {
+				res->cache_misses++;
+			}
+		}
+	}
+
+	// Gather the remaining obligations into a list of their own
+	ObligationList todo = { ast_alloc(slots * sizeof(Obligation)), 0, 0 };
+	int* index = malloc(slots * sizeof(int));
+	if (!index) { perror("malloc"); exit(1); }
+
+	for (int i = 0; i < count; i++) {
+		if (done[i]) continue;
+		index[todo.count] = i;
+		todo.items[todo.count++] = obligations->items[i];
+	}
+	todo.capacity = todo.count;
+
+	ObligationResult* fresh = malloc((todo.count ? todo.count : 1) * sizeof(ObligationResult));
+	if (!fresh) { perror("malloc"); exit(1); }
+	solve_obligations(v->pool, &todo, fresh);
+
+	for (int k = 0; k < todo.count; k++) {
+		res->results[index[k]] = fresh[k];
+		res->translate_ms += fresh[k].translate_ms;
+		if (cache) proof_cache_store(cache, &keys[index[k]], &fresh[k]);
+	}
+
+	free(fresh);
+	free(index);
+	free(done);
+
+	res->solve_ms = now_ms() - t0;
+	res->status = summarize(res->results, count);
+}
+
+// Forget a program: free its results and recycle the arena for the next one
+void verifier_release(Verifier* v, VerifyResult* res) {
+	if (res->results) {
+		free_ObligationResults(res->results, res->obligations->count);
+		free(res->results);
+	}
+	memset(res, 0, sizeof(VerifyResult));
+
+	solver_pool_reset(v->pool);	// cached terms point into the arena
+	arena_reset(v->arena);
+	stats_count(COUNTER_NODES_FREED, ast_nodes_allocated() - v->nodes_mark);
+	v->nodes_mark = ast_nodes_allocated();
+}
+
+void free_Verifier(Verifier* v) {
+	if (!v) return;
+
+	free_SolverPool(v->pool);
+	free_Arena(v->arena);
+	stats_count(COUNTER_NODES_FREED, ast_nodes_allocated() - v->nodes_mark);
+	free(v);
+}
+
+
+/* ------------------------------------------------------------------
+	Batch mode: every argument is a .t file or a directory whose .t
+	files (sorted by name) are verified. One JSON object per file is
+	written to `out`, followed by a summary object.
+   ------------------------------------------------------------------ */
+
+typedef struct {
+	char** items;
+	int count;
+	int capacity;
+} PathList;
+
+static void path_list_add(PathList* list, char* path) {
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? 2 * list->capacity : 16;
+		list->items = realloc(list->items, list->capacity * sizeof(char*));
+		if (!list->items) { perror("realloc"); exit(1); }
+	}
+	list->items[list->count++] = path;
+}
+
+static int compare_paths(const void* a, const void* b) {
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int has_suffix(const char* s, const char* suffix) {
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// Expand a directory argument into its .t files; other paths are kept as is
+static void expand_path(PathList* list, const char* path) {
+	DIR* dir = opendir(path);
+	if (!dir) {
+		path_list_add(list, strdup(path));
+		return;
+	}
+
+	int first = list->count;
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!has_suffix(entry->d_name, ".t")) continue;
+
+		size_t len = strlen(path) + strlen(entry->d_name) + 2;
+		char* file = malloc(len);
+		if (!file) { perror("malloc"); exit(1); }
+		snprintf(file, len, "%s/%s", path, entry->d_name);
+		path_list_add(list, file);
+	}
+	closedir(dir);
+
+	qsort(list->items + first, list->count - first, sizeof(char*), compare_paths);
+}
+
+// Write a JSON string literal
+void fprint_json_string(FILE* out, const char* s) {
+	fputc('"', out);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+		else if (c == '\n') fputs("\\n", out);
+		else if (c < 0x20) fprintf(out, "\\u%04x", c);
+		else fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+// One line: {"file": ..., "result": ..., "obligations": ..., "failed": [...], "prescreen": ..., timings}
+void fprint_result_json(FILE* out, const char* name, const VerifyResult* res) {
+	fprintf(out, "{\"file\": ");
+	fprint_json_string(out, name);
+	fprintf(out, ", \"result\": \"%s\"", program_status_to_string(res->status));
+
+	if (res->obligations) {
+		fprintf(out, ", \"obligations\": %d, \"failed\": [", res->obligations->count);
+		int nfailed = 0;
+		for (int i = 0; i < res->obligations->count; i++) {
+			if (res->results[i].verdict == VERDICT_VALID) continue;
+			if (nfailed++) fprintf(out, ", ");
+			fprint_json_string(out, res->obligations->items[i].label);
+		}
+		fprintf(out, "], \"vc_nodes\": %llu, \"vc_nodes_raw\": %llu", res->vc_tree_nodes, res->vc_raw_nodes);
+	}
+	if (res->cache_hits + res->cache_misses > 0) {
+		fprintf(out, ", \"cache_hits\": %d, \"cache_misses\": %d", res->cache_hits, res->cache_misses);
+	}
+	fprint_prescreen_json(out, res);
+
+	fprintf(out, ", \"parse_ms\": %.3f, \"vcgen_ms\": %.3f, \"translate_ms\": %.3f, \"solve_ms\": %.3f, \"total_ms\": %.3f}\n",
+		res->parse_ms, res->vcgen_ms, res->translate_ms, res->solve_ms,
+		res->parse_ms + res->prescreen_ms + res->vcgen_ms + res->solve_ms);
+}
+
+// ", "prescreen": {"runs": ..., "failed": ..., "inputs": ...}" if the program was run
+void fprint_prescreen_json(FILE* out, const VerifyResult* res) {
+	const PrescreenResult* p = &res->prescreen;
+	if (!p->runs) return;
+
+	fprintf(out, ", \"prescreen\": {\"runs\": %d, \"inconclusive\": %d", p->runs, p->inconclusive);
+	if (p->failed) {
+		fprintf(out, ", \"failed\": ");
+		fprint_json_string(out, p->failed);
+		fprintf(out, ", \"inputs\": ");
+		fprint_json_string(out, p->inputs);
+	}
+	fprintf(out, ", \"ms\": %.3f}", res->prescreen_ms);
+}
+
+// State shared by the workers of one batch
+typedef struct {
+	PathList* files;
+	VerifierOptions opts;
+	FILE* out;
+	char** lines;			// JSON line of each finished file
+	int next;				// next file to hand out (atomic)
+	int next_print;			// lines are written in file order
+	int counts[PROGRAM_IO_ERROR + 1];
+	pthread_mutex_t lock;
+} BatchJob;
+
+// Verify file i and publish its line; ready lines are flushed in order
+static void batch_file(Verifier* v, BatchJob* job, int i) {
+	const char* path = job->files->items[i];
+	VerifyResult res;
+	FILE* in = fopen(path, "r");
+
+	if (!in) {
+		memset(&res, 0, sizeof(VerifyResult));
+		res.status = PROGRAM_IO_ERROR;
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+	} else {
+		verify_file(v, in, &res);
+		fclose(in);
+	}
+
+	char* line = NULL;
+	size_t len = 0;
+	FILE* mem = open_memstream(&line, &len);
+	if (!mem) { perror("open_memstream"); exit(1); }
+	fprint_result_json(mem, path, &res);
+	fclose(mem);
+
+	pthread_mutex_lock(&job->lock);
+	job->lines[i] = line;
+	job->counts[res.status]++;
+	while (job->next_print < job->files->count && job->lines[job->next_print]) {
+		fputs(job->lines[job->next_print], job->out);
+		free(job->lines[job->next_print]);
+		job->next_print++;
+	}
+	fflush(job->out);
+	pthread_mutex_unlock(&job->lock);
+
+	verifier_release(v, &res);
+}
+
+// Program-level worker: its own verifier (arena, Z3 context), one file at a time
+static void* batch_worker(void* arg) {
+	BatchJob* job = arg;
+	Verifier* v = create_Verifier(job->opts);
+
+	for (;;) {
+		int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+		if (i >= job->files->count) break;
+		batch_file(v, job, i);
+	}
+
+	free_Verifier(v);
+	return NULL;
+}
+
+// Verify every file; returns the number of files that could not be proved correct.
+// With jobs > 1, independent files are verified concurrently, one per thread
+// (each with a single solver context) instead of splitting one file's obligations.
+int verify_batch(Verifier* v, char** paths, int npaths, FILE* out) {
+	PathList files = { NULL, 0, 0 };
+	for (int i = 0; i < npaths; i++) expand_path(&files, paths[i]);
+
+	BatchJob job;
+	memset(&job, 0, sizeof(BatchJob));
+	job.files = &files;
+	job.opts = v->opts;
+	job.opts.jobs = 1;
+	job.out = out;
+	job.lines = calloc(files.count ? files.count : 1, sizeof(char*));
+	if (!job.lines) { perror("malloc"); exit(1); }
+	pthread_mutex_init(&job.lock, NULL);
+
+	int nthreads = v->opts.jobs < files.count ? v->opts.jobs : files.count;
+	double start = now_ms();
+
+	if (nthreads <= 1) {
+		for (int i = 0; i < files.count; i++) batch_file(v, &job, i);
+	} else {
+		pthread_t* threads = malloc(nthreads * sizeof(pthread_t));
+		if (!threads) { perror("malloc"); exit(1); }
+
+		for (int i = 0; i < nthreads; i++) {
+			if (pthread_create(&threads[i], NULL, batch_worker, &job) != 0) {
+				perror("pthread_create");
+				exit(1);
+			}
+		}
+		for (int i = 0; i < nthreads; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		free(threads);
+	}
+
+	fprintf(out, "{\"summary\": {\"files\": %d", files.count);
+	for (int s = PROGRAM_CORRECT; s <= PROGRAM_IO_ERROR; s++) {
+		fprintf(out, ", \"%s\": %d", program_status_to_string(s), job.counts[s]);
+	}
+	if (v->opts.cache) {
+		fprintf(out, ", \"cache_hits\": %lu, \"cache_misses\": %lu", v->opts.cache->hits, v->opts.cache->misses);
+	}
+	fprintf(out, ", \"total_ms\": %.3f}}\n", now_ms() - start);
+
+	pthread_mutex_destroy(&job.lock);
+	for (int i = 0; i < files.count; i++) free(files.items[i]);
+	free(files.items);
+	free(job.lines);
+	return files.count - job.counts[PROGRAM_CORRECT];
+}
+
+const char* program_status_to_string(ProgramStatus status) {
+	switch (status) {
+		case PROGRAM_CORRECT:		return "correct";
+		case PROGRAM_INCORRECT:		return "incorrect";
+		case PROGRAM_UNKNOWN:		return "unknown";
+		case PROGRAM_UNSUPPORTED:	return "unsupported";
+		case PROGRAM_PARSE_ERROR:	return "parse_error";
+		case PROGRAM_IO_ERROR:		return "io_error";
+	}
+	return "?";
+}
@@ -0,0 +1,73 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "arena.h"
+#include "vc.h"
+#include "solver.h"
+#include "cache.h"
+#include "interp.h"
+
+typedef enum {
+	PROGRAM_CORRECT,		// every obligation valid
+	PROGRAM_INCORRECT,		// some obligation has a counterexample
+	PROGRAM_UNKNOWN,		// no counterexample, but not everything proved
+	PROGRAM_UNSUPPORTED,	// e.g. "PRECONDITION: true"
+	PROGRAM_PARSE_ERROR,
+	PROGRAM_IO_ERROR
+} ProgramStatus;
+
+typedef struct VerifierOptions_ {
+	int jobs;				// solver threads (one Z3 context each)
+	int split;				// split the VC into obligations
+	int simplify;			// simplify the VC before splitting it
+	int passive;			// linear-size VC generation (see passive.c)
+	int prescreen;			// concrete runs before VC generation (0: none, see interp.c)
+	ProofCache* cache;		// verdicts from earlier runs (optional, shared)
+	SolverConfig solver;	// limits and portfolio
+} VerifierOptions;
+
+// Everything that outlives one program: the AST arena and the solver
+// pool with its Z3 contexts (and their `fact` declarations).
+typedef struct Verifier_ {
+	VerifierOptions opts;
+	Arena* arena;
+	unsigned long nodes_mark;	// ast_nodes_allocated() when the arena was last emptied
+	SolverPool* pool;
+} Verifier;
+
+// Outcome of verifying one program. Obligations live in the verifier's
+// arena, so a result is only valid until verifier_release.
+typedef struct VerifyResult_ {
+	ProgramStatus status;
+	DLL* program;
+	ASTNode* vc;
+	ObligationList* obligations;
+	ObligationResult* results;		// one per obligation (malloc'd)
+	unsigned long long vc_raw_nodes;		// before simplification
+	unsigned long long vc_tree_nodes;
+	unsigned long vc_distinct_nodes;
+	unsigned long nodes_allocated;
+	int cache_hits, cache_misses;
+	PrescreenResult prescreen;		// failed: found incorrect without the solver
+	double parse_ms, prescreen_ms, vcgen_ms, solve_ms;
+	double translate_ms;			// part of solve_ms, summed over obligations (and threads)
+} VerifyResult;
+
+
+Verifier* create_Verifier(VerifierOptions opts);
+void verify_file(Verifier* v, FILE* in, VerifyResult* res);
+void verify_prepare(Verifier* v, FILE* in, VerifyResult* res);
+void verify_solve(Verifier* v, VerifyResult* res, const char* known);
+void verifier_release(Verifier* v, VerifyResult* res);
+void free_Verifier(Verifier* v);
+
+int verify_batch(Verifier* v, char** paths, int npaths, FILE* out);
+void fprint_result_json(FILE* out, const char* name, const VerifyResult* res);
+void fprint_prescreen_json(FILE* out, const VerifyResult* res);
+void fprint_json_string(FILE* out, const char* s);
+
+const char* program_status_to_string(ProgramStatus status);
+
+#endif
@@ -1,167 +1,320 @@
 #include "z3_helpers.h"
+#include <stdlib.h>
 #include <string.h>
 
+// A new reference to t, taken before any other API call can free it
+static Z3_ast referenced(Z3_context ctx, Z3_ast t) {
+	if (t) Z3_inc_ref(ctx, t);
+	return t;
+}
+
+
+// ------------------------------------------------------------
+// Create a context with its declarations and empty caches
+// The context is reference counted, so terms are freed as soon as the
+// caches drop them (a context lives for a whole batch or server run):
+// everything the env holds is inc_ref'd, and any other Z3 object must be
+// inc_ref'd before the next API call and dec_ref'd when done.
+// ------------------------------------------------------------
+Z3Env* create_Z3Env(void) {
+	Z3Env* env = malloc(sizeof(Z3Env));
+	if (!env) { perror("malloc"); exit(1); }
+
+	Z3_config cfg = Z3_mk_config();
+	env->ctx = Z3_mk_context_rc(cfg);
+	Z3_del_config(cfg);
+
+	env->int_sort = Z3_mk_int_sort(env->ctx);
+	Z3_inc_ref(env->ctx, Z3_sort_to_ast(env->ctx, env->int_sort));
+
+	init_z3(env); // user-defined funcs like fact
+
+	// Cache for variables (so we reuse Z3 symbols consistently),
+	// indexed by symbol and grown on demand
+	env->vars = NULL;
+	env->nvars = 0;
+
+	// Cache of translated subterms (each distinct node is converted once)
+	env->term_cache = create_PtrMap(256);
+	return env;
+}
+
+// Forget translated terms; required whenever the AST arena is reset, since
+// the cache is keyed by node address. Variables and declarations are kept.
+void z3env_clear_terms(Z3Env* env) {
+	clear_ptrmap_with_context(env->term_cache, env->ctx);
+}
+
+void free_Z3Env(Z3Env* env) {
+	if (!env) return;
+
+	free_ptrmap_with_context(env->term_cache, env->ctx);
+	for (int i = 0; i < env->nvars; i++) {
+		if (env->vars[i]) Z3_dec_ref(env->ctx, env->vars[i]);
+	}
+	free(env->vars);
+	Z3_dec_ref(env->ctx, Z3_func_decl_to_ast(env->ctx, env->fact_func));
+	Z3_dec_ref(env->ctx, Z3_sort_to_ast(env->ctx, env->int_sort));
+	Z3_del_context(env->ctx);
+	free(env);
+}
+
 
 // ------------------------------------------------------------
 // Initialize recursive Z3 functions (here: factorial fact: Int -> Int)
 // ------------------------------------------------------------
-void init_z3(Z3_context ctx) {
-	Z3_sort int_sort = Z3_mk_int_sort(ctx); // integer sort
+void init_z3(Z3Env* env) {
+	Z3_context ctx = env->ctx;
+	Z3_sort int_sort = env->int_sort; // integer sort
 	Z3_symbol fact_name = Z3_mk_string_symbol(ctx, "fact"); // symbol for "fact"
 
 	// Create recursive function declaration fact : Int → Int
-	fact_func = Z3_mk_rec_func_decl(ctx, fact_name, 1, &int_sort, int_sort);
+	Z3_func_decl fact_func = Z3_mk_rec_func_decl(ctx, fact_name, 1, &int_sort, int_sort);
+	Z3_inc_ref(ctx, Z3_func_decl_to_ast(ctx, fact_func)); // released by free_Z3Env
+	env->fact_func = fact_func;
 
 	// Bound variable n (argument of fact)
-	Z3_ast n = Z3_mk_bound(ctx, 0, int_sort);
-	Z3_ast zero = Z3_mk_int(ctx, 0, int_sort);
-	Z3_ast one = Z3_mk_int(ctx, 1, int_sort);
+	Z3_ast n = referenced(ctx, Z3_mk_bound(ctx, 0, int_sort));
+	Z3_ast zero = referenced(ctx, Z3_mk_int(ctx, 0, int_sort));
+	Z3_ast one = referenced(ctx, Z3_mk_int(ctx, 1, int_sort));
 	
 	// Build n - 1
-	Z3_ast n_minus_one = Z3_mk_sub(ctx, 2, (Z3_ast[]){n, one});
+	Z3_ast n_minus_one = referenced(ctx, Z3_mk_sub(ctx, 2, (Z3_ast[]){n, one}));
 
 	// Recursive call fact(n-1)
-	Z3_ast fact_n_minus_one = Z3_mk_app(ctx, fact_func, 1, &n_minus_one);
+	Z3_ast fact_n_minus_one = referenced(ctx, Z3_mk_app(ctx, fact_func, 1, &n_minus_one));
 
 	// Define factorial body:
 	//   if n == 0 then 1 else n * fact(n-1)
-	Z3_ast body = Z3_mk_ite(ctx,
-							Z3_mk_eq(ctx, n, zero), // condition (n == 0)
-							one,					 // then branch
-							Z3_mk_mul(ctx, 2, (Z3_ast[]){n, fact_n_minus_one}));  // else branch
+	Z3_ast is_zero = referenced(ctx, Z3_mk_eq(ctx, n, zero));							// condition (n == 0)
+	Z3_ast recurse = referenced(ctx, Z3_mk_mul(ctx, 2, (Z3_ast[]){n, fact_n_minus_one}));	// else branch
+	Z3_ast body = referenced(ctx, Z3_mk_ite(ctx, is_zero, one, recurse));
 
 	// Register the recursive definition with Z3
 	// Z3_add_rec_def(ctx, f, n, bound_vars[], body)
 	Z3_add_rec_def(ctx, fact_func, 1, &n, body);
+
+	Z3_ast terms[] = { n, zero, one, n_minus_one, fact_n_minus_one, is_zero, recurse, body };
+	for (int i = 0; i < (int)(sizeof(terms) / sizeof(terms[0])); i++) Z3_dec_ref(ctx, terms[i]);
 }
 
 
+static Z3_ast translate_node(Z3Env* env, ASTNode* node);
+
+// Number of children a node is translated from (fact has no second argument)
+static int operand_count(ASTNode* node) {
+	if (node->type == NODE_FUNCTION && node->function.func == FUNC_FACT) return 1;
+	return child_count(node);
+}
+
+// Translation of an operand, already in the cache
+static Z3_ast translated(Z3Env* env, ASTNode* node) {
+	return ptrmap_get(env->term_cache, node);
+}
+
 // ------------------------------------------------------------
 // Translate custom ASTNode into Z3_ast
-// This recursively maps my AST into Z3 formulas/terms
+// Every node is translated once per context: results are kept in
+// env->term_cache, so shared subterms and nodes seen by earlier calls are
+// reused. The walk is bottom-up on an explicit stack (a node is translated
+// once its operands are in the cache), so deep formulas do not grow the
+// native stack. Any failure makes the whole formula fail.
 // ------------------------------------------------------------
-Z3_ast ast_to_z3(Z3_context ctx, ASTNode* node, HashMap* var_cache) {
+Z3_ast ast_to_z3(Z3Env* env, ASTNode* node) {
+	typedef struct { ASTNode* node; int expanded; } TranslateFrame;
+
 	if (!node) {
 		fprintf(stderr, "ast_to_z3: NULL node\n");
 		return NULL;
 	}
+	Z3_ast res = translated(env, node);
+	if (res) return res;
+
+	WorkStack stack;
+	work_init(&stack, sizeof(TranslateFrame));
+	*(TranslateFrame*)work_push(&stack) = (TranslateFrame){ node, 0 };
+
+	TranslateFrame* top;
+	while ((top = work_pop(&stack)) != NULL) {
+		TranslateFrame frame = *top;
+		if (translated(env, frame.node)) continue;
+
+		int n = operand_count(frame.node);
+
+		if (!frame.expanded && n > 0) {
+			// come back once the operands are translated
+			*(TranslateFrame*)work_push(&stack) = (TranslateFrame){ frame.node, 1 };
+			for (int i = n - 1; i >= 0; i--) {
+				ASTNode* kid = *child_slot(frame.node, i);
+				if (!kid) {
+					fprintf(stderr, "ast_to_z3: NULL child in %s node\n", frame.node->type == NODE_FUNCTION
+						? func_to_string(frame.node->function.func) : "operator");
+					work_free(&stack);
+					return NULL;
+				}
+				if (!translated(env, kid)) *(TranslateFrame*)work_push(&stack) = (TranslateFrame){ kid, 0 };
+			}
+			continue;
+		}
 
-	// Type caches (static: reused across calls)
-	static Z3_sort int_sort = NULL;
-	static Z3_sort bool_sort = NULL;
+		res = translate_node(env, frame.node); // released by z3env_clear_terms / free_Z3Env
+		if (!res) {
+			work_free(&stack);
+			return NULL;
+		}
+		ptrmap_put(env->term_cache, frame.node, res);
+	}
+
+	work_free(&stack);
+	return translated(env, node);
+}
 
-	if (!int_sort) int_sort = Z3_mk_int_sort(ctx);
-	if (!bool_sort) bool_sort = Z3_mk_bool_sort(ctx);
+// Translate one node; its operands are in the cache. The result is
+// referenced for the caller.
+static Z3_ast translate_node(Z3Env* env, ASTNode* node) {
+	Z3_context ctx = env->ctx;
+	Z3_sort int_sort = env->int_sort;
 
 	switch (node->type) {
 
 		// ---------------- Number literal ----------------
 		case NODE_NUMBER: {
-			return Z3_mk_int(ctx, node->number, int_sort);
+			return referenced(ctx, Z3_mk_int(ctx, node->number, int_sort));
 		}
 
 		// ---------------- Boolean literal ----------------
 		case NODE_BOOL: {
-			return node->bool_value ? Z3_mk_true(ctx) : Z3_mk_false(ctx);
+			return referenced(ctx, node->bool_value ? Z3_mk_true(ctx) : Z3_mk_false(ctx));
 		}
 
 		// ---------------- Identifier (variable) ----------------
 		case NODE_ID: {
-			if (!var_cache) {
-				fprintf(stderr, "Error: var_cache is NULL\n");
-				return NULL;
-			}
-
 			// Lookup variable in cache
-			int index = hash(var_cache, node->id_name);
-			HashEntry* entry = var_cache->table[index];
-
-			while (entry) {
-				if (strcmp(entry->key, node->id_name) == 0) {
-					return (Z3_ast) entry->value; // reuse existing symbol
-				}
-				entry = entry->next;
+			int id = node->id_sym;
+			if (id < env->nvars && env->vars[id]) return referenced(ctx, env->vars[id]); // reuse existing symbol
+
+			if (id >= env->nvars) {
+				int n = env->nvars ? env->nvars : 64;
+				while (n <= id) n *= 2;
+				env->vars = realloc(env->vars, n * sizeof(Z3_ast));
+				if (!env->vars) { perror("realloc"); exit(1); }
+				memset(env->vars + env->nvars, 0, (n - env->nvars) * sizeof(Z3_ast));
+				env->nvars = n;
 			}
 
 			// Not found → create fresh Z3 constant and store it
 			Z3_symbol sym = Z3_mk_string_symbol(ctx, node->id_name);
 			Z3_ast var = Z3_mk_const(ctx, sym, int_sort);
 			Z3_inc_ref(ctx, var); // keep var alive until explicit free
-			insert_HashMap(var_cache, node->id_name, var);
-			return var;
+			env->vars[id] = var;
+			return referenced(ctx, var);
 		}
 
 		// ---------------- Binary operator ----------------
 		case NODE_BIN_OP: {
-			Z3_ast left = ast_to_z3(ctx, node->binary_op.left, var_cache);
-			Z3_ast right = ast_to_z3(ctx, node->binary_op.right, var_cache);
-
-			if (!left || !right) {
-				fprintf(stderr, "ast_to_z3: NULL child in binary op\n");
-				return NULL;
-			}
-
+			Z3_ast left = translated(env, node->binary_op.left);
+			Z3_ast right = translated(env, node->binary_op.right);
 			Z3_ast args[2] = {left, right};
 
 			// Map operators to Z3 API
-			if (strcmp(node->binary_op.op, "+") == 0) return Z3_mk_add(ctx, 2, args);
-			if (strcmp(node->binary_op.op, "-") == 0) return Z3_mk_sub(ctx, 2, args);
-			if (strcmp(node->binary_op.op, "*") == 0) return Z3_mk_mul(ctx, 2, args);
-			if (strcmp(node->binary_op.op, "/") == 0) return Z3_mk_div(ctx, left, right);
-			if (strcmp(node->binary_op.op, "%") == 0) return Z3_mk_mod(ctx, left, right);
-
-			if (strcmp(node->binary_op.op, "<") == 0) return Z3_mk_lt(ctx, left, right);
-			if (strcmp(node->binary_op.op, ">") == 0) return Z3_mk_gt(ctx, left, right);
-			if (strcmp(node->binary_op.op, ">=") == 0) return Z3_mk_ge(ctx, left, right);
-			if (strcmp(node->binary_op.op, "<=") == 0) return Z3_mk_le(ctx, left, right);
-
-			if (strcmp(node->binary_op.op, "==") == 0) return Z3_mk_eq(ctx, left, right);
-			if (strcmp(node->binary_op.op, "!=") == 0) return Z3_mk_distinct(ctx, 2, args);
-
-			if (strcmp(node->binary_op.op, "and") == 0) return Z3_mk_and(ctx, 2, args);
-			if (strcmp(node->binary_op.op, "or") == 0) return Z3_mk_or(ctx, 2, args);
-			if (strcmp(node->binary_op.op, "->") == 0) return Z3_mk_implies(ctx, left, right);
-
+			switch (node->binary_op.op) {
+				case OP_ADD:	return referenced(ctx, Z3_mk_add(ctx, 2, args));
+				case OP_SUB:	return referenced(ctx, Z3_mk_sub(ctx, 2, args));
+				case OP_MUL:	return referenced(ctx, Z3_mk_mul(ctx, 2, args));
+				case OP_DIV:	return referenced(ctx, Z3_mk_div(ctx, left, right));
+				case OP_MOD:	return referenced(ctx, Z3_mk_mod(ctx, left, right));
+
+				case OP_LT:		return referenced(ctx, Z3_mk_lt(ctx, left, right));
+				case OP_GT:		return referenced(ctx, Z3_mk_gt(ctx, left, right));
+				case OP_GE:		return referenced(ctx, Z3_mk_ge(ctx, left, right));
+				case OP_LE:		return referenced(ctx, Z3_mk_le(ctx, left, right));
+
+				case OP_EQ:		return referenced(ctx, Z3_mk_eq(ctx, left, right));
+				case OP_NEQ:	return referenced(ctx, Z3_mk_distinct(ctx, 2, args));
+
+				case OP_AND:	return referenced(ctx, Z3_mk_and(ctx, 2, args));
+				case OP_OR:		return referenced(ctx, Z3_mk_or(ctx, 2, args));
+				case OP_IMPLY:	return referenced(ctx, Z3_mk_implies(ctx, left, right));
+
+				default:		break;
+			}
 
-			fprintf(stderr, "ast_to_z3: Unknown binary op '%s'\n", node->binary_op.op);
+			fprintf(stderr, "ast_to_z3: Unknown binary op '%s'\n", op_to_string(node->binary_op.op));
 			return NULL;
 		}
 
+		// ---------------- Flattened chain: one call for all operands ----------------
+		case NODE_NARY: {
+			int n = node->nary.count;
+			Z3_ast small[8];
+			Z3_ast* args = n <= 8 ? small : malloc(n * sizeof(Z3_ast));
+			if (!args) { perror("malloc"); exit(1); }
+			for (int i = 0; i < n; i++) args[i] = translated(env, node->nary.args[i]);
+
+			Z3_ast res = NULL;
+			switch (node->nary.op) {
+				case OP_AND:	res = referenced(ctx, Z3_mk_and(ctx, n, args)); break;
+				case OP_OR:		res = referenced(ctx, Z3_mk_or(ctx, n, args)); break;
+				case OP_ADD:	res = referenced(ctx, Z3_mk_add(ctx, n, args)); break;
+				case OP_MUL:	res = referenced(ctx, Z3_mk_mul(ctx, n, args)); break;
+				default:
+					fprintf(stderr, "ast_to_z3: Unknown n-ary op '%s'\n", op_to_string(node->nary.op));
+					break;
+			}
+			if (args != small) free(args);
+			return res;
+		}
+
 		// ---------------- Unary operator ----------------
 		case NODE_UNARY_OP: {
-			Z3_ast child = ast_to_z3(ctx, node->unary_op.child, var_cache);
-			
-			if (!child) {
-				fprintf(stderr, "ast_to_z3: NULL child in unary op\n");
-				return NULL;
-			}
-			
-			if (strcmp(node->unary_op.op, "not") == 0) return Z3_mk_not(ctx, child);
+			Z3_ast child = translated(env, node->unary_op.child);
+			if (node->unary_op.op == OP_NOT) return referenced(ctx, Z3_mk_not(ctx, child));
 
-			fprintf(stderr, "ast_to_z3: Unknown unary op '%s'\n", node->unary_op.op);
+			fprintf(stderr, "ast_to_z3: Unknown unary op '%s'\n", op_to_string(node->unary_op.op));
 			return NULL;
 		}
 
+		// ---------------- Label (logically transparent) ----------------
+		case NODE_LABEL:
+			return referenced(ctx, translated(env, node->label.child));
+
+		// ---------------- Conditional term ----------------
+		case NODE_ITE: {
+			Z3_ast c = translated(env, node->ite.condition);
+			Z3_ast t = translated(env, node->ite.then_term);
+			Z3_ast e = translated(env, node->ite.else_term);
+			return referenced(ctx, Z3_mk_ite(ctx, c, t, e));
+		}
+
 		// ---------------- Function call ----------------
 		case NODE_FUNCTION: {
-			if (strcmp(node->function.fname, "fact") == 0) {
-				extern Z3_func_decl fact_func;
-				if (!fact_func) {
-					fprintf(stderr, "ast_to_z3: fact_func not initialized\n");
-					return NULL;
-				}
+			Z3_ast arg1 = translated(env, node->function.arg1);
 
-				Z3_ast arg = ast_to_z3(ctx, node->function.arg1, var_cache);
-				if (!arg) {
-					fprintf(stderr, "ast_to_z3: NULL argument to fact function\n");
-					return NULL;
+			switch (node->function.func) {
+				case FUNC_FACT: {
+					if (!env->fact_func) {
+						fprintf(stderr, "ast_to_z3: fact_func not initialized\n");
+						return NULL;
+					}
+
+					// Apply fact(arg)
+					return referenced(ctx, Z3_mk_app(ctx, env->fact_func, 1, &arg1));
 				}
 
-				// Apply fact(arg)
-				return Z3_mk_app(ctx, fact_func, 1, &arg);
+				case FUNC_MIN:
+				case FUNC_MAX: {
+					Z3_ast arg2 = translated(env, node->function.arg2);
+
+					// min(a, b) = ite(a < b, a, b); max(a, b) = ite(a < b, b, a)
+					Z3_ast lt = referenced(ctx, Z3_mk_lt(ctx, arg1, arg2));
+					Z3_ast res = referenced(ctx, node->function.func == FUNC_MIN
+						? Z3_mk_ite(ctx, lt, arg1, arg2) : Z3_mk_ite(ctx, lt, arg2, arg1));
+					if (lt) Z3_dec_ref(ctx, lt);
+					return res;
+				}
 			}
 
-			fprintf(stderr, "ast_to_z3: Unknown function '%s'\n", node->function.fname);
+			fprintf(stderr, "ast_to_z3: Unknown function '%s'\n", func_to_string(node->function.func));
 			return NULL;
 		}
 
@@ -5,9 +5,23 @@
 #include "ast.h"
 #include "hashmap.h"
 
-extern Z3_func_decl fact_func;
+// One Z3 context and everything derived from it: sorts, the `fact`
+// declaration and the translation caches. An environment must only be used
+// by one thread at a time.
+typedef struct Z3Env_ {
+	Z3_context ctx;
+	Z3_sort int_sort;
+	Z3_func_decl fact_func;
+	Z3_ast* vars;			// symbol -> Z3 constant (NULL: not created yet)
+	int nvars;				// length of vars
+	PtrMap* term_cache;		// ASTNode* -> translated term (keyed by address)
+} Z3Env;
 
-void init_z3(Z3_context ctx);
-Z3_ast ast_to_z3(Z3_context ctx, ASTNode* node, HashMap* var_cache);
+Z3Env* create_Z3Env(void);
+void z3env_clear_terms(Z3Env* env);
+void free_Z3Env(Z3Env* env);
+
+void init_z3(Z3Env* env);
+Z3_ast ast_to_z3(Z3Env* env, ASTNode* node);
 
 #endif
\ No newline at end of file
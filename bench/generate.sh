@@ -0,0 +1,98 @@
+#!/bin/sh
+# Print a synthetic program of the given kind and size (all verify correct):
+#
+#   bench/generate.sh straight 10000 > /tmp/straight.t
+#
+#   straight N   N assignments in a row, each using the previous one
+#   nested K     K nested while loops
+#   ifs K        K if/else in sequence (2^K paths for the hoare VC)
+#   wide N       one assignment summing N variables
+#   vars N       N variables, each with its own pre- and postcondition
+#   shared N     x = x + x; N times (the VC term is a DAG of 2^N leaves)
+
+kind=$1
+n=${2:-10}
+
+case "$kind" in
+straight)
+	echo "x1 = n + 1;"
+	i=2
+	while [ "$i" -le "$n" ]; do
+		echo "x$i = x$((i - 1)) + 1;"
+		i=$((i + 1))
+	done
+	echo
+	echo "PRECONDITION: n >= 0"
+	echo "POSTCONDITION: x$n == n + $n"
+	;;
+
+nested)
+	# while (i1 < n) { i2 = 0; while (i2 < n) { ... i2 = i2 + 1; } i1 = i1 + 1; }
+	i=1
+	while [ "$i" -le "$n" ]; do
+		echo "i$i = 0;"
+		echo "while (i$i < n) INVARIANT (i$i >= 0 and i$i <= n) VARIANT (n - i$i) {"
+		i=$((i + 1))
+	done
+	i=$n
+	while [ "$i" -ge 1 ]; do
+		echo "i$i = i$i + 1;"
+		echo "}"
+		i=$((i - 1))
+	done
+	echo
+	echo "PRECONDITION: n >= 0"
+	echo "POSTCONDITION: i1 == n"
+	;;
+
+ifs)
+	exec "$(dirname "$0")/../tests/generate_ifs.sh" "$n"
+	;;
+
+wide)
+	sum="x1"
+	pre="x1 >= 0"
+	i=2
+	while [ "$i" -le "$n" ]; do
+		sum="$sum + x$i"
+		pre="$pre and x$i >= 0"
+		i=$((i + 1))
+	done
+	echo "s = $sum;"
+	echo
+	echo "PRECONDITION: $pre"
+	echo "POSTCONDITION: s >= 0"
+	;;
+
+vars)
+	pre="v1 >= 0"
+	post="v1 >= 1"
+	echo "v1 = v1 + 1;"
+	i=2
+	while [ "$i" -le "$n" ]; do
+		echo "v$i = v$i + $i;"
+		pre="$pre and v$i >= 0"
+		post="$post and v$i >= $i"
+		i=$((i + 1))
+	done
+	echo
+	echo "PRECONDITION: $pre"
+	echo "POSTCONDITION: $post"
+	;;
+
+shared)
+	i=1
+	while [ "$i" -le "$n" ]; do
+		echo "x = x + x;"
+		i=$((i + 1))
+	done
+	echo
+	echo "PRECONDITION: x >= 0"
+	echo "POSTCONDITION: x >= 0"
+	;;
+
+*)
+	echo "usage: $0 straight|nested|ifs|wide|vars|shared N" >&2
+	exit 2
+	;;
+esac
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Verify the synthetic programs of bench/generate.sh and print one JSON line
+# per program (parse, VC generation, Z3 translation and solve times):
+#
+#   make bench                                  # writes bench_output.txt
+#   bench/run.sh ./myparser old_output.txt      # also compares with an earlier run
+#
+# Extra verifier options can be given in BENCH_FLAGS (e.g. "--vcgen passive").
+# With an earlier output, every program whose total time grew by more than
+# 20% is listed and the script exits with 1.
+
+bin=${1:-./myparser}
+old=$2
+here=$(dirname "$0")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+for spec in "straight 2000" "nested 6" "ifs 12" "wide 1000" "vars 300" "shared 40"; do
+	set -- $spec
+	"$here/generate.sh" "$1" "$2" > "$dir/$1-$2.t"
+done
+
+# Only the per-file lines, keyed by the program name rather than the temp dir
+"$bin" $BENCH_FLAGS --batch "$dir" | grep '^{"file"' | sed "s|$dir/||" > "$dir/current"
+cat "$dir/current"
+
+[ -n "$old" ] || exit 0
+
+awk -v old="$old" '
+	function field(line, name,   s) {
+		s = substr(line, index(line, "\"" name "\": ") + length(name) + 4)
+		sub(/[,}].*/, "", s)
+		gsub(/"/, "", s)
+		return s
+	}
+	BEGIN {
+		while ((getline line < old) > 0)
+			if (line ~ /^\{"file"/) before[field(line, "file")] = field(line, "total_ms")
+	}
+	{
+		f = field($0, "file"); t = field($0, "total_ms")
+		if (f in before && t + 0 > 1.2 * before[f]) {
+			printf "slower: %s %.3f ms -> %.3f ms\n", f, before[f], t > "/dev/stderr"
+			slow = 1
+		}
+	}
+	END { exit slow }
+' "$dir/current"
@@ -0,0 +1,115 @@
+/* ------------------------------------------------------------------
+	Microbenchmark of the variable table (Symbol/symbol.c)
+	For a growing number of variables, names are interned the way the
+	lexer interns a new identifier, then read back the two ways the
+	pipeline reads them, in a scattered order as a VC refers to its
+	variables:
+		- intern_symbol() on a name already seen (the lexer, for every
+		  further occurrence of the identifier);
+		- the symbol-indexed array of ast_to_z3 (Z3Env.vars), grown
+		  the same way.
+	The pointer-keyed map (Hashmap/hashmap.c) is measured alongside, as
+	the term cache of ast_to_z3 uses it: one node address per variable,
+	spaced like nodes in the AST arena, put once then looked up in the
+	same scattered order.
+
+		make symbol_bench && ./symbol_bench [lookups]
+   ------------------------------------------------------------------ */
+#include "hashmap.h"
+#include "symbol.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+	long lookups = argc > 1 ? atol(argv[1]) : 10000000;
+	const int sizes[] = { 16, 256, 4096, 65536 };
+
+	printf("%10s %14s %14s %14s %14s %14s\n", "variables", "intern ns/op", "by name ns/op", "by sym ns/op",
+		"put ns/op", "by node ns/op");
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+		int n = sizes[s];
+
+		// Symbols live for the whole process: a new prefix per size
+		char** names = malloc(n * sizeof(char*));
+		int* syms = malloc(n * sizeof(int));
+		if (!names || !syms) { perror("malloc"); exit(1); }
+		for (int i = 0; i < n; i++) {
+			names[i] = malloc(24);
+			if (!names[i]) { perror("malloc"); exit(1); }
+			snprintf(names[i], 24, "v%d_%d", s, i);
+		}
+
+		double t0 = now();
+		for (int i = 0; i < n; i++) syms[i] = intern_symbol(names[i]);
+		double t1 = now();
+
+		// n is a power of two and the step is odd: every name is visited
+		unsigned long found = 0;
+		long k = 0;
+		for (long r = 0; r < lookups; r++) {
+			k = (k + 40503) & (n - 1);
+			found += intern_symbol(names[k]);
+		}
+		double t2 = now();
+
+		// Values are never dereferenced: any non-NULL pointer will do
+		int nvars = 0;
+		void** vars = NULL;
+		for (int i = 0; i < n; i++) {
+			if (syms[i] >= nvars) {
+				int m = nvars ? nvars : 64;
+				while (m <= syms[i]) m *= 2;
+				vars = realloc(vars, m * sizeof(void*));
+				if (!vars) { perror("realloc"); exit(1); }
+				memset(vars + nvars, 0, (m - nvars) * sizeof(void*));
+				nvars = m;
+			}
+			vars[syms[i]] = (void*)(uintptr_t)(i + 1);
+		}
+
+		double t3 = now();
+		k = 0;
+		for (long r = 0; r < lookups; r++) {
+			k = (k + 40503) & (n - 1);
+			found += (uintptr_t)vars[syms[k]];
+		}
+		double t4 = now();
+
+		// Keys are never dereferenced either: addresses 64 bytes apart
+		char* nodes = malloc((size_t)n * 64);
+		if (!nodes) { perror("malloc"); exit(1); }
+		PtrMap* terms = create_PtrMap(256);
+
+		double t5 = now();
+		for (int i = 0; i < n; i++) ptrmap_put(terms, nodes + (size_t)i * 64, (void*)(uintptr_t)(i + 1));
+		double t6 = now();
+		k = 0;
+		for (long r = 0; r < lookups; r++) {
+			k = (k + 40503) & (n - 1);
+			found += (uintptr_t)ptrmap_get(terms, nodes + k * 64);
+		}
+		double t7 = now();
+
+		printf("%10d %14.1f %14.1f %14.1f %14.1f %14.1f\n", n, (t1 - t0) * 1e9 / n,
+			(t2 - t1) * 1e9 / lookups, (t4 - t3) * 1e9 / lookups,
+			(t6 - t5) * 1e9 / n, (t7 - t6) * 1e9 / lookups);
+		if (found == 0) printf("(no hits)\n"); // keeps the loops from being optimized away
+
+		free_PtrMap(terms);
+		free(nodes);
+		free(vars);
+		for (int i = 0; i < n; i++) free(names[i]);
+		free(names);
+		free(syms);
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+i = 0;
+
+while (i < n) INVARIANT (
+    i >= 0
+) VARIANT (n - i) {
+    if (i % 2 == 0) {
+        i = i + 1;
+    } else {
+        i = i + 2;
+    }
+}
+
+PRECONDITION: n >= 0
+POSTCONDITION: i >= n
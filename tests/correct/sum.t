@@ -1,7 +1,7 @@
 sum = 0;
 i = 0;
 
-while (i != n) INVARIANT (sum == (i * (i + 1)) / 2) VARIANT (n - i) {
+while (i != n) INVARIANT (sum == (i * (i + 1)) / 2 and i <= n) VARIANT (n - i) {
     i = i + 1;
     sum = sum + i;
 }
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Print a program of K if/else statements in sequence (default 10):
+#
+#   tests/generate_ifs.sh 16 > /tmp/ifs16.t
+#   ./myparser --vcgen hoare   < /tmp/ifs16.t    # VC size ~ 2^K
+#   ./myparser --vcgen passive < /tmp/ifs16.t    # VC size ~ K
+#
+# The postcondition mentions the variable set by every if, so the if rule
+# copies it into 2^K paths. With "incorrect" as second argument the
+# postcondition claims y1 > 0, which fails for c1 == 0.
+
+k=${1:-10}
+
+i=1
+while [ "$i" -le "$k" ]; do
+	echo "if (c$i > 0) { y$i = c$i; } else { y$i = 0 - c$i; }"
+	i=$((i + 1))
+done
+
+post="y1 >= 0"
+[ "$2" = "incorrect" ] && post="y1 > 0"
+i=2
+while [ "$i" -le "$k" ]; do
+	post="$post and y$i >= 0"
+	i=$((i + 1))
+done
+
+echo
+echo "PRECONDITION: n >= 0"
+echo "POSTCONDITION: $post"
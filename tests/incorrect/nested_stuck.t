@@ -0,0 +1,11 @@
+i = 0;
+while (i < n) INVARIANT (i <= n) VARIANT (n - i) {
+    i = i + 0;
+    j = i;
+    while (j < n) INVARIANT (j <= n) VARIANT (n - j) {
+        j = j + 1;
+    }
+}
+
+PRECONDITION: n >= 1
+POSTCONDITION: i == n
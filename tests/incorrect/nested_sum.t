@@ -1,8 +1,14 @@
 total = 0;
 i = 1;
-while (i <= n) INVARIANT (total == (i - 1) * i * (i + 1) / 6) VARIANT (n - i + 1) {
+while (i != n + 1) INVARIANT (
+    6 * total == (i - 1) * i * (2 * i - 1)
+    and i >= 1 and i <= n + 1
+) VARIANT (n - i + 1) {
     j = 1;
-    while (j <= i) INVARIANT (total == ((i - 1) * i * (i + 1) / 6) + (j - 1) * i) VARIANT (i - j + 1) {
+    while (j != i + 1) INVARIANT (
+        6 * total == (i - 1) * i * (2 * i - 1) + 6 * (j - 1) * i
+        and j >= 1 and j <= i + 1 and i <= n
+    ) VARIANT (i - j + 1) {
         total = total + i;
         j = j + 1;
     }
@@ -10,4 +16,4 @@ while (i <= n) INVARIANT (total == (i - 1) * i * (i + 1) / 6) VARIANT (n - i + 1
 }
 
 PRECONDITION: n >= 0
-POSTCONDITION: total == n * (n + 1) * (n + 2) / 6 + 5
\ No newline at end of file
+POSTCONDITION: 6 * total == n * (n + 1) * (2 * n + 1) + 6
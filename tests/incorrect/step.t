@@ -0,0 +1,13 @@
+i = 1;
+
+while (i < n) INVARIANT (
+    i >= 0
+) VARIANT (n - i) {
+    i = i + 1;
+    if (i > 1) {
+        i = i - 1;
+    } else {}
+}
+
+PRECONDITION: n >= 0
+POSTCONDITION: i >= n